@@ -0,0 +1,112 @@
+// =========================================================================
+// Copyright 2021 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#include <catch.h>
+#include <yuuki/deadline_queue.h>
+#include <yuuki/threadpool.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <random>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+// A synthetic RPC trace: Poisson arrivals offered at ~90% of the pool's
+// capacity, each request with a random service time and a random deadline.
+// It is replayed against a FIFO pool and an EDF pool (with and without
+// skipping expired requests), reporting how many deadlines were met.
+struct request {
+  std::chrono::microseconds arrival;
+  std::chrono::microseconds service;
+  std::chrono::microseconds slack;
+};
+
+std::vector<request> make_trace(int workers) {
+  const int NUM = 4000;
+  const double mean_service_us = 200.0;
+  std::default_random_engine eng(42);
+  std::exponential_distribution<double> gap(0.9 * workers / mean_service_us);
+  std::uniform_int_distribution<int> service(100, 300);
+  std::uniform_int_distribution<int> slack(1000, 20000);
+  std::vector<request> trace;
+  double t = 0;
+  for (int i = 0; i != NUM; ++i) {
+    t += gap(eng);
+    trace.push_back({std::chrono::microseconds(static_cast<int64_t>(t)),
+                     std::chrono::microseconds(service(eng)),
+                     std::chrono::microseconds(slack(eng))});
+  }
+  return trace;
+}
+
+void spin(std::chrono::microseconds d) {
+  auto until = yuuki::deadline_clock::now() + d;
+  while (yuuki::deadline_clock::now() < until) {
+  }
+}
+
+template <typename Submit>
+double replay(const std::vector<request>& trace, Submit submit) {
+  std::atomic<int> met{0};
+  std::vector<std::future<void>> futs;
+  futs.reserve(trace.size());
+  auto start = yuuki::deadline_clock::now();
+  for (auto& r : trace) {
+    std::this_thread::sleep_until(start + r.arrival);
+    auto deadline = start + r.arrival + r.slack;
+    futs.emplace_back(submit(deadline, [&met, &r, deadline]() {
+      spin(r.service);
+      if (yuuki::deadline_clock::now() <= deadline) ++met;
+    }));
+  }
+  for (auto& fut : futs) {
+    try {
+      fut.get();
+    } catch (const std::system_error&) {
+      // skipped: counts as missed
+    }
+  }
+  return 100.0 * met / trace.size();
+}
+
+TEST_CASE("deadline - trace replay") {
+  const int workers = std::thread::hardware_concurrency();
+  const auto trace = make_trace(workers);
+
+  yuuki::threadpool<> fifo;
+  fifo.init(workers);
+  double fifo_met =
+      replay(trace, [&fifo](auto, auto f) { return fifo.async(f); });
+
+  yuuki::deadline_threadpool edf;
+  edf.init(workers);
+  double edf_met = replay(trace, [&edf](auto deadline, auto f) {
+    return yuuki::async_with_deadline(edf, deadline, f);
+  });
+  double skip_met = replay(trace, [&edf](auto deadline, auto f) {
+    return yuuki::async_with_deadline(edf, deadline, yuuki::skip_expired, f);
+  });
+
+  std::printf(
+      "deadlines met: FIFO %.1f%%, EDF %.1f%%, EDF + skip_expired %.1f%%\n",
+      fifo_met, edf_met, skip_met);
+}
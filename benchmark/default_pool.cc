@@ -0,0 +1,141 @@
+// =========================================================================
+// Copyright 2021 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#include <catch.h>
+#include <sys/resource.h>
+#include <yuuki/default_pool.h>
+#include <yuuki/threadpool.h>
+
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using steady = std::chrono::steady_clock;
+
+// 16 components, each used to own a `threadpool` with `init(30)`. Compare
+// that with one lazily started pool of `default_concurrency()` workers that
+// the components share through executor views.
+const int COMPONENTS = 16;
+
+double ms_since(steady::time_point start) {
+  return std::chrono::duration<double, std::milli>(steady::now() - start)
+      .count();
+}
+
+void spin() {
+  auto until = steady::now() + std::chrono::microseconds(20);
+  while (steady::now() < until) {
+  }
+}
+
+TEST_CASE("default_pool - startup") {
+  // time until every component has run its first task.
+  auto start = steady::now();
+  {
+    std::vector<std::unique_ptr<yuuki::threadpool<>>> pools;
+    for (int i = 0; i != COMPONENTS; ++i) {
+      pools.push_back(std::make_unique<yuuki::threadpool<>>());
+      pools.back()->init(30);
+    }
+    for (auto& pool : pools) {
+      pool->async([]() {}).get();
+    }
+    std::printf("startup: %d pools of 30 threads: %8.2fms\n", COMPONENTS,
+                ms_since(start));
+  }
+  start = steady::now();
+  {
+    yuuki::threadpool<> shared;
+    shared.init_lazily(yuuki::default_concurrency());
+    std::vector<yuuki::executor<yuuki::threadpool<>>> views;
+    for (int i = 0; i != COMPONENTS; ++i) {
+      views.emplace_back(shared, 2);
+    }
+    for (auto& view : views) {
+      view.async([]() {}).get();
+    }
+    std::printf("startup: one shared lazy pool:    %8.2fms (%d threads)\n",
+                ms_since(start), shared.size());
+  }
+}
+
+long involuntary_switches() {  // NOLINT(runtime/int)
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_nivcsw;
+}
+
+// every component submits a burst of 20us tasks at once and waits for them.
+template <typename Submit>
+double burst(Submit submit) {
+  const int TASKS = 500;
+  auto start = steady::now();
+  std::vector<std::thread> components;
+  for (int c = 0; c != COMPONENTS; ++c) {
+    components.emplace_back([&submit, c]() {
+      std::vector<std::future<void>> futs;
+      futs.reserve(TASKS);
+      for (int i = 0; i != TASKS; ++i) {
+        futs.push_back(submit(c, spin));
+      }
+      for (auto& fut : futs) {
+        fut.get();
+      }
+    });
+  }
+  for (auto& t : components) {
+    t.join();
+  }
+  return ms_since(start);
+}
+
+TEST_CASE("default_pool - oversubscription") {
+  const int ROUNDS = 5;
+  std::vector<std::unique_ptr<yuuki::threadpool<>>> pools;
+  for (int i = 0; i != COMPONENTS; ++i) {
+    pools.push_back(std::make_unique<yuuki::threadpool<>>());
+    pools.back()->init(30);
+  }
+  double own = 0;
+  long own_switches = involuntary_switches();  // NOLINT(runtime/int)
+  for (int r = 0; r != ROUNDS; ++r) {
+    own += burst([&pools](int c, auto f) { return pools[c]->async(f); });
+  }
+  own_switches = involuntary_switches() - own_switches;
+  pools.clear();
+
+  const int n = yuuki::default_concurrency();
+  std::vector<yuuki::executor<yuuki::threadpool<>>> views;
+  for (int i = 0; i != COMPONENTS; ++i) {
+    views.push_back(yuuki::make_executor(n));
+  }
+  double shared = 0;
+  long shared_switches = involuntary_switches();  // NOLINT(runtime/int)
+  for (int r = 0; r != ROUNDS; ++r) {
+    shared += burst([&views](int c, auto f) { return views[c].async(f); });
+  }
+  shared_switches = involuntary_switches() - shared_switches;
+  std::printf("burst of %d x 500 tasks, per round:\n", COMPONENTS);
+  std::printf("  %d pools of 30 threads: %8.2fms, %6ld involuntary switches\n",
+              COMPONENTS, own / ROUNDS, own_switches / ROUNDS);
+  std::printf(
+      "  default_pool, %2d threads: %8.2fms, %6ld involuntary switches\n",
+      yuuki::default_pool().size(), shared / ROUNDS, shared_switches / ROUNDS);
+}
@@ -0,0 +1,122 @@
+// =========================================================================
+// Copyright 2021 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#include <catch.h>
+#include <yuuki/fair_queue.h>
+#include <yuuki/threadpool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+using steady = std::chrono::steady_clock;
+
+const int WORKERS = 4;
+
+void spin(std::chrono::microseconds d) {
+  auto until = steady::now() + d;
+  while (steady::now() < until) {
+  }
+}
+
+// An aggressor floods the pool with 20us tasks (seconds of backlog), then a
+// victim submits one 20us task per millisecond; report how long the victim's
+// tasks waited before starting.
+template <typename Aggressor, typename Victim>
+void victim_latency(const char* name, Aggressor aggressor, Victim victim) {
+  std::vector<std::future<void>> flood;
+  for (int i = 0; i != 50000 * WORKERS; ++i) {
+    flood.push_back(aggressor([] { spin(20us); }));
+  }
+  std::vector<double> waits(200);
+  std::vector<std::future<void>> futs;
+  for (auto& wait : waits) {
+    auto submitted = steady::now();
+    futs.push_back(victim([&wait, submitted] {
+      wait = std::chrono::duration<double, std::micro>(steady::now() -
+                                                       submitted).count();
+      spin(20us);
+    }));
+    std::this_thread::sleep_for(1ms);
+  }
+  for (auto& fut : futs) {
+    fut.get();
+  }
+  std::sort(waits.begin(), waits.end());
+  std::printf("%-6s victim wait: p50 %9.0fus, p99 %9.0fus\n", name,
+              waits[waits.size() / 2], waits[waits.size() * 99 / 100]);
+}
+
+TEST_CASE("fair_queue - victim latency under an aggressor") {
+  {
+    yuuki::threadpool<> pool;
+    pool.init(WORKERS);
+    auto submit = [&pool](auto f) { return pool.async(f); };
+    victim_latency("FIFO", submit, submit);
+    pool.cancel();
+  }
+  {
+    yuuki::fair_threadpool pool;
+    pool.init(WORKERS);
+    auto aggressor = pool.make_tenant();
+    auto victim = pool.make_tenant();
+    victim_latency(
+        "fair", [&aggressor](auto f) { return aggressor.async(f); },
+        [&victim](auto f) { return victim.async(f); });
+    pool.cancel();
+  }
+}
+
+// Three tenants with weights 4:2:1 keep the pool saturated; report the share
+// of the workers each got over 300ms, and what a cap of one worker does.
+TEST_CASE("fair_queue - throughput isolation") {
+  yuuki::fair_threadpool pool;
+  pool.init(WORKERS);
+  auto a = pool.make_tenant(4);
+  auto b = pool.make_tenant(2);
+  auto c = pool.make_tenant(1);
+  auto capped = pool.make_tenant(8, 1);
+  std::atomic<bool> measuring{true};
+  std::atomic<long> done[4] = {{0}, {0}, {0}, {0}};  // NOLINT(runtime/int)
+  std::vector<std::future<void>> futs;
+  for (int i = 0; i != 100000; ++i) {
+    int k = 0;
+    for (auto* t : {&a, &b, &c, &capped}) {
+      futs.push_back(t->async([&measuring, &done, k] {
+        spin(10us);
+        if (measuring.load(std::memory_order_relaxed)) {
+          ++done[k];
+        }
+      }));
+      ++k;
+    }
+  }
+  std::this_thread::sleep_for(300ms);
+  measuring = false;
+  pool.cancel();
+  const double total = done[0] + done[1] + done[2] + done[3];
+  std::printf(
+      "shares: weight 4 %.1f%%, weight 2 %.1f%%, weight 1 %.1f%%, "
+      "weight 8 capped at 1 worker %.1f%%\n",
+      100 * done[0] / total, 100 * done[1] / total, 100 * done[2] / total,
+      100 * done[3] / total);
+}
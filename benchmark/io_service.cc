@@ -0,0 +1,131 @@
+// =========================================================================
+// Copyright 2021 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#include <catch.h>
+#include <yuuki/io_service.h>
+#include <yuuki/threadpool.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <future>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Random 4 KiB reads from a 256 MiB file, keeping `depth` reads in flight.
+// "blocking" delegates a `pread` per read to a pool of 4 workers, so no more
+// than 4 are ever in flight no matter the depth, and the workers can do
+// nothing else meanwhile; the io_service lets the kernel queue all of them.
+// The file is opened with `O_DIRECT` where possible so that reads reach the
+// device instead of the page cache.
+const size_t BLOCK = 4096;
+const size_t FILE_SIZE = size_t{256} << 20;
+const size_t NUM = 20000;
+
+struct bench_file {
+  bench_file() {
+    char path[] = "/tmp/yuuki_io_bench_XXXXXX";
+    int w = mkstemp(path);
+    std::vector<char> chunk(1 << 20, 'y');
+    for (size_t off = 0; off < FILE_SIZE; off += chunk.size()) {
+      if (write(w, chunk.data(), chunk.size()) < 0) {
+        break;
+      }
+    }
+    fsync(w);
+    close(w);
+    fd = open(path, O_RDONLY | O_DIRECT);
+    direct = fd >= 0;
+    if (!direct) {
+      fd = open(path, O_RDONLY);
+    }
+    unlink(path);
+  }
+  ~bench_file() {
+    close(fd);
+  }
+  int fd;
+  bool direct;
+};
+
+std::vector<off_t> make_offsets() {
+  std::default_random_engine eng(42);
+  std::uniform_int_distribution<size_t> block(0, FILE_SIZE / BLOCK - 1);
+  std::vector<off_t> offsets(NUM);
+  for (auto& off : offsets) {
+    off = static_cast<off_t>(block(eng) * BLOCK);
+  }
+  return offsets;
+}
+
+template <typename Submit>
+double run(size_t depth, const std::vector<off_t>& offsets, Submit submit) {
+  // one aligned buffer per slot in flight.
+  char* bufs = static_cast<char*>(std::aligned_alloc(BLOCK, depth * BLOCK));
+  std::deque<std::future<size_t>> window;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i != offsets.size(); ++i) {
+    if (window.size() == depth) {
+      window.front().get();
+      window.pop_front();
+    }
+    window.push_back(submit(bufs + (i % depth) * BLOCK, offsets[i]));
+  }
+  while (!window.empty()) {
+    window.front().get();
+    window.pop_front();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::free(bufs);
+  return offsets.size() / elapsed.count();
+}
+
+TEST_CASE("io_service - random 4K reads") {
+  bench_file file;
+  const auto offsets = make_offsets();
+  yuuki::threadpool<> pool;
+  pool.init(4);
+  std::printf("random 4K reads, %s\n", file.direct ? "O_DIRECT" : "page cache");
+  std::printf("%6s %14s %14s %14s\n", "depth", "blocking", "io_uring",
+              "io threads");
+  for (size_t depth : {1, 8, 32, 128}) {
+    const int fd = file.fd;
+    double blocking = run(depth, offsets, [&pool, fd](char* buf, off_t off) {
+      return pool.async([fd, buf, off]() -> size_t {
+        return static_cast<size_t>(pread(fd, buf, BLOCK, off));
+      });
+    });
+    yuuki::io_service<yuuki::threadpool<>> uring(pool, depth);
+    double via_uring = run(depth, offsets, [&uring, fd](char* buf, off_t off) {
+      return uring.read(fd, buf, BLOCK, off);
+    });
+    using io_service = yuuki::io_service<yuuki::threadpool<>>;
+    io_service threads(pool, depth, io_service::backend::threads);
+    double via_threads =
+        run(depth, offsets, [&threads, fd](char* buf, off_t off) {
+          return threads.read(fd, buf, BLOCK, off);
+        });
+    std::printf("%6zu %10.0f/s %10.0f/s %10.0f/s\n", depth, blocking,
+                via_uring, via_threads);
+  }
+}
@@ -0,0 +1,138 @@
+// =========================================================================
+// Copyright 2021 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#include <catch.h>
+#include <yuuki/parallel_algorithm.h>
+#include <yuuki/threadpool.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// `std::execution::par` of libstdc++ runs on TBB, so it is only measured by
+// the `parallel_algorithm_tbb` target, which links it.
+#if defined(YUUKI_WITH_STD_PAR) && defined(__cpp_lib_parallel_algorithm)
+#define YUUKI_BENCH_STD_PAR 1
+#include <execution>
+#endif
+
+// 1e8 and 1e9 elements need 0.4 and 4 GB per copy of the input and minutes
+// per case; append them on a machine that has both to spare.
+const size_t SIZES[] = {10000, 100000, 1000000, 10000000};
+
+std::vector<int32_t> random_input(size_t n) {
+  std::default_random_engine eng(42);
+  std::uniform_int_distribution<int32_t> dist;
+  std::vector<int32_t> res(n);
+  for (auto& v : res) {
+    v = dist(eng);
+  }
+  return res;
+}
+
+std::string name(const char* algo, size_t n) {
+  return std::string(algo) + " - " + std::to_string(n);
+}
+
+// every run sorts a fresh copy of the same input.
+template <typename Sort>
+void sort_fresh_copies(Catch::Benchmark::Chronometer& meter,
+                       const std::vector<int32_t>& data, Sort&& sort) {
+  std::vector<std::vector<int32_t>> inputs(meter.runs(), data);
+  meter.measure([&inputs, &sort](int i) { sort(inputs[i]); });
+}
+
+TEST_CASE("parallel_algorithm - sort") {
+  yuuki::threadpool<> pool;
+  pool.init(std::max(std::thread::hardware_concurrency(), 1U));
+  for (size_t n : SIZES) {
+    const auto data = random_input(n);
+    BENCHMARK_ADVANCED(name("std::sort", n))
+    (Catch::Benchmark::Chronometer meter) {
+      sort_fresh_copies(meter, data, [](std::vector<int32_t>& v) {
+        std::sort(v.begin(), v.end());
+      });
+    };
+#if defined(YUUKI_BENCH_STD_PAR)
+    BENCHMARK_ADVANCED(name("std::sort(par)", n))
+    (Catch::Benchmark::Chronometer meter) {
+      sort_fresh_copies(meter, data, [](std::vector<int32_t>& v) {
+        std::sort(std::execution::par, v.begin(), v.end());
+      });
+    };
+#endif
+    BENCHMARK_ADVANCED(name("yuuki::parallel_sort", n))
+    (Catch::Benchmark::Chronometer meter) {
+      sort_fresh_copies(meter, data, [&pool](std::vector<int32_t>& v) {
+        yuuki::parallel_sort(pool, v.begin(), v.end());
+      });
+    };
+  }
+}
+
+TEST_CASE("parallel_algorithm - inclusive scan") {
+  yuuki::threadpool<> pool;
+  pool.init(std::max(std::thread::hardware_concurrency(), 1U));
+  for (size_t n : SIZES) {
+    const auto data = random_input(n);
+    std::vector<int32_t> out(n);
+    BENCHMARK(name("std::inclusive_scan", n)) {
+      return std::inclusive_scan(data.begin(), data.end(), out.begin());
+    };
+#if defined(YUUKI_BENCH_STD_PAR)
+    BENCHMARK(name("std::inclusive_scan(par)", n)) {
+      return std::inclusive_scan(std::execution::par, data.begin(), data.end(),
+                                 out.begin());
+    };
+#endif
+    BENCHMARK(name("yuuki::parallel_inclusive_scan", n)) {
+      return yuuki::parallel_inclusive_scan(pool, data.begin(), data.end(),
+                                            out.begin());
+    };
+  }
+}
+
+TEST_CASE("parallel_algorithm - transform and copy_if") {
+  yuuki::threadpool<> pool;
+  pool.init(std::max(std::thread::hardware_concurrency(), 1U));
+  auto hash = [](int32_t v) {
+    return static_cast<int32_t>(static_cast<uint32_t>(v) * 2654435761U);
+  };
+  auto even = [](int32_t v) { return v % 2 == 0; };
+  for (size_t n : SIZES) {
+    const auto data = random_input(n);
+    std::vector<int32_t> out(n);
+    BENCHMARK(name("std::transform", n)) {
+      return std::transform(data.begin(), data.end(), out.begin(), hash);
+    };
+    BENCHMARK(name("yuuki::parallel_transform", n)) {
+      return yuuki::parallel_transform(pool, data.begin(), data.end(),
+                                       out.begin(), hash);
+    };
+    BENCHMARK(name("std::copy_if", n)) {
+      return std::copy_if(data.begin(), data.end(), out.begin(), even);
+    };
+    BENCHMARK(name("yuuki::parallel_copy_if", n)) {
+      return yuuki::parallel_copy_if(pool, data.begin(), data.end(),
+                                     out.begin(), even);
+    };
+  }
+}
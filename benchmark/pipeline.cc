@@ -0,0 +1,157 @@
+// =========================================================================
+// Copyright 2021 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#include <catch.h>
+#include <yuuki/pipeline.h>
+#include <yuuki/threadpool.h>
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <iostream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// parse -> transform -> compress -> write over `NUM` blocks of `BLOCK` bytes;
+// `buffer` tracks how many bytes are alive at once to compare peak memory.
+const int NUM = 2048;
+const size_t BLOCK = 64 * 1024;
+
+std::atomic<size_t> live_bytes{0};
+std::atomic<size_t> peak_bytes{0};
+
+class buffer {
+ public:
+  explicit buffer(size_t n) : buffer(std::vector<uint8_t>(n)) {
+  }
+  explicit buffer(std::vector<uint8_t>&& data) : data_(std::move(data)) {
+    size_t now = live_bytes += data_.size();
+    size_t peak = peak_bytes.load();
+    while (now > peak && !peak_bytes.compare_exchange_weak(peak, now)) {
+    }
+  }
+  ~buffer() {
+    live_bytes -= data_.size();
+  }
+  buffer(buffer&& other) : data_(std::move(other.data_)) {
+    other.data_.clear();
+  }
+  buffer& operator=(buffer&& other) {
+    live_bytes -= data_.size();
+    data_ = std::move(other.data_);
+    other.data_.clear();
+    return *this;
+  }
+
+ public:
+  std::vector<uint8_t>& data() {
+    return data_;
+  }
+
+ private:
+  std::vector<uint8_t> data_;
+};
+
+buffer parse(int i) {
+  buffer b(BLOCK);
+  uint32_t x = i + 1;
+  for (auto& byte : b.data()) {
+    x = x * 1664525 + 1013904223;
+    byte = static_cast<uint8_t>(x >> 29);  // few distinct values: compressible
+  }
+  return b;
+}
+
+buffer transform(buffer b) {
+  uint8_t prev = 0;
+  for (auto& byte : b.data()) {
+    byte ^= prev;
+    prev = byte;
+  }
+  return b;
+}
+
+buffer compress(buffer b) {
+  std::vector<uint8_t> out;
+  auto& in = b.data();
+  for (size_t i = 0; i != in.size();) {
+    size_t j = i;
+    while (j != in.size() && j - i != 255 && in[j] == in[i]) ++j;
+    out.push_back(static_cast<uint8_t>(j - i));
+    out.push_back(in[i]);
+    i = j;
+  }
+  return buffer(std::move(out));
+}
+
+uint64_t write(buffer b, uint64_t sum) {
+  for (auto byte : b.data()) {
+    sum = sum * 31 + byte;
+  }
+  return sum;
+}
+
+TEST_CASE("pipeline - benchmark") {
+  yuuki::threadpool pool;
+  pool.init(std::thread::hardware_concurrency());
+
+  uint64_t naive_sum = 0;
+  peak_bytes = live_bytes.load();
+  BENCHMARK("naive async") {
+    std::vector<std::future<buffer>> futs;
+    futs.reserve(NUM);
+    for (int i = 0; i != NUM; ++i) {
+      futs.emplace_back(pool.async(
+          [](int i) -> buffer { return compress(transform(parse(i))); }, i));
+    }
+    uint64_t sum = 0;
+    for (auto& fut : futs) {
+      sum = write(fut.get(), sum);
+    }
+    naive_sum = sum;
+    return sum;
+  };
+  std::cout << "naive async peak: " << peak_bytes / 1024 << " KiB" << std::endl;
+
+  int next = 0;
+  uint64_t sum = 0;
+  auto p = yuuki::make_pipeline(2 * std::thread::hardware_concurrency(),
+                                [&next](yuuki::flow_control& fc) -> buffer {
+                                  if (next == NUM) {
+                                    fc.stop();
+                                    return buffer(0);
+                                  }
+                                  return parse(next++);
+                                })
+               .then(yuuki::stage_mode::parallel, transform)
+               .then(yuuki::stage_mode::parallel, compress)
+               .then(yuuki::stage_mode::serial_in_order,
+                     [&sum](buffer b) -> void {
+                       sum = write(std::move(b), sum);
+                     });
+  peak_bytes = live_bytes.load();
+  BENCHMARK("yuuki::pipeline") {
+    next = 0;
+    sum = 0;
+    p.run(pool);
+    return sum;
+  };
+  std::cout << "yuuki::pipeline peak: " << peak_bytes / 1024 << " KiB"
+            << std::endl;
+  REQUIRE(sum == naive_sum);
+}
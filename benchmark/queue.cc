@@ -17,13 +17,23 @@
 
 #include <catch.h>
 #include <yuuki/blocking_queue.h>
+#include <yuuki/lockfree_queue.h>
+#include <yuuki/spsc_queue.h>
 #include <yuuki/threadpool.h>
 #include <yuuki/threadsafe_queue.h>
 
+#include <array>
+#include <atomic>
 #include <cstdint>
+#include <functional>
 #include <future>
+#include <memory_resource>
+#include <string>
 #include <thread>
+#include <vector>
 
+// The cases below push through `threadpool::async`, so they mostly measure
+// the pool and its futures; queue_micro.cc drives the queues alone.
 const int NUM = 2048;
 
 TEST_CASE("queue - multi_push") {
@@ -105,3 +115,170 @@ TEST_CASE("queue - multi_push_pop") {
     return;
   };
 }
+
+// One raw producer thread and one raw consumer thread moving `SPSC_NUM`
+// integers; `pop` is spun on (with a yield) for the non-blocking queues.
+const int SPSC_NUM = 1 << 22;
+
+template <typename Queue>
+void spsc_transfer(Queue& q) {
+  std::thread producer([&q]() {
+    for (int i = 0; i != SPSC_NUM; ++i) {
+      while (!q.push(i)) std::this_thread::yield();
+    }
+  });
+  int holder;
+  for (int i = 0; i != SPSC_NUM; ++i) {
+    while (!q.pop(holder)) std::this_thread::yield();
+  }
+  producer.join();
+}
+
+template <typename Queue>
+void unbounded_transfer(Queue& q) {
+  std::thread producer([&q]() {
+    for (int i = 0; i != SPSC_NUM; ++i) {
+      q.push(i);
+    }
+  });
+  int holder;
+  for (int i = 0; i != SPSC_NUM; ++i) {
+    while (!q.pop(holder)) std::this_thread::yield();
+  }
+  producer.join();
+}
+
+TEST_CASE("queue - spsc") {
+  yuuki::blocking_queue<int> b_queue;
+  BENCHMARK("b_queue") {
+    return unbounded_transfer(b_queue);
+  };
+
+  yuuki::threadsafe_queue<int> ts_queue;
+  BENCHMARK("ts_queue") {
+    return unbounded_transfer(ts_queue);
+  };
+
+  yuuki::spsc_queue<int> spsc_queue(4096);
+  BENCHMARK("spsc_queue") {
+    return spsc_transfer(spsc_queue);
+  };
+
+  BENCHMARK("spsc_queue.push_n/pop_n") {
+    const int BATCH = 64;
+    std::thread producer([&spsc_queue, BATCH]() {
+      std::array<int, BATCH> in;
+      for (int i = 0; i != SPSC_NUM; i += BATCH) {
+        for (int j = 0; j != BATCH; ++j) in[j] = i + j;
+        size_t pushed = 0;
+        while (pushed != BATCH) {
+          pushed += spsc_queue.push_n(in.begin() + pushed, BATCH - pushed);
+          if (pushed != BATCH) std::this_thread::yield();
+        }
+      }
+    });
+    std::array<int, BATCH> out;
+    for (int popped = 0; popped != SPSC_NUM;) {
+      size_t n = spsc_queue.pop_n(out.begin(), BATCH);
+      if (n == 0) std::this_thread::yield();
+      popped += n;
+    }
+    producer.join();
+    return;
+  };
+
+  yuuki::spsc_channel<int> channel(4096);
+  BENCHMARK("spsc_channel") {
+    return spsc_transfer(channel);
+  };
+}
+
+// Single-threaded fill-and-drain, so allocation dominates over contention.
+template <typename Queue>
+void fill_and_drain(Queue& q) {
+  const int N = 1 << 16;
+  for (int i = 0; i != N; ++i) {
+    q.push(i);
+  }
+  int holder;
+  while (q.pop(holder)) {
+  }
+}
+
+TEST_CASE("queue - memory resource") {
+  std::pmr::unsynchronized_pool_resource unsync;
+  std::pmr::synchronized_pool_resource sync;
+
+  yuuki::threadsafe_queue<int> ts_heap;
+  BENCHMARK("ts_queue - default heap") {
+    return fill_and_drain(ts_heap);
+  };
+  yuuki::pmr::threadsafe_queue<int> ts_unsync(&unsync);
+  BENCHMARK("ts_queue - unsynchronized_pool_resource") {
+    return fill_and_drain(ts_unsync);
+  };
+  yuuki::pmr::threadsafe_queue<int> ts_sync(&sync);
+  BENCHMARK("ts_queue - synchronized_pool_resource") {
+    return fill_and_drain(ts_sync);
+  };
+
+  yuuki::blocking_queue<int> b_heap;
+  BENCHMARK("b_queue - default heap") {
+    return fill_and_drain(b_heap);
+  };
+  yuuki::pmr::blocking_queue<int> b_unsync(&unsync);
+  BENCHMARK("b_queue - unsynchronized_pool_resource") {
+    return fill_and_drain(b_unsync);
+  };
+  yuuki::pmr::blocking_queue<int> b_sync(&sync);
+  BENCHMARK("b_queue - synchronized_pool_resource") {
+    return fill_and_drain(b_sync);
+  };
+}
+
+// `producers` raw threads push `MPMC_NUM` integers in total while four raw
+// threads pop them.
+const int MPMC_NUM = 1 << 16;
+
+template <typename Queue>
+void mpmc_transfer(Queue& q, int producers) {
+  const int CONSUMERS = 4;
+  std::atomic<int> popped{0};
+  std::vector<std::thread> threads;
+  for (int p = 0; p != producers; ++p) {
+    threads.emplace_back([&q, p, producers]() {
+      for (int i = p; i < MPMC_NUM; i += producers) {
+        q.push(i);
+      }
+    });
+  }
+  for (int c = 0; c != CONSUMERS; ++c) {
+    threads.emplace_back([&q, &popped]() {
+      int holder;
+      while (popped.load(std::memory_order_relaxed) < MPMC_NUM) {
+        if (q.pop(holder)) {
+          popped.fetch_add(1, std::memory_order_relaxed);
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+TEST_CASE("queue - lock-free mpmc") {
+  for (int producers : {1, 2, 4, 8, 16, 32, 64}) {
+    const std::string suffix = " - " + std::to_string(producers) + " producers";
+    yuuki::threadsafe_queue<int> ts_queue;
+    BENCHMARK("ts_queue" + suffix) {
+      return mpmc_transfer(ts_queue, producers);
+    };
+    yuuki::lockfree_queue<int> lf_queue;
+    BENCHMARK("lockfree_queue" + suffix) {
+      return mpmc_transfer(lf_queue, producers);
+    };
+  }
+}
@@ -0,0 +1,439 @@
+// =========================================================================
+// Copyright 2021 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+// Queue microbenchmark: drives every queue from raw threads, without a pool
+// or futures in the way, so that only the queue is measured.
+//
+//   queue_micro [--ops=N] [queue...]
+//
+// For each queue, element type, burst pattern and producer/consumer count it
+// reports the throughput, percentiles of the time a single push or
+// successful pop takes (every 16th call is timed, clock reads included), and
+// the hardware cache misses per element if `perf_event_open` is permitted.
+// Threads are pinned round-robin to the CPUs the process may use. Consumers
+// poll; the run ends once every producer is done and the queue is drained.
+
+#include <yuuki/blocking_queue.h>
+#include <yuuki/lockfree_queue.h>
+#include <yuuki/spsc_queue.h>
+#include <yuuki/threadsafe_queue.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+using steady = std::chrono::steady_clock;
+
+int64_t nanos(steady::duration d) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+}
+
+// an element of a cache line.
+struct line64 {
+  uint64_t words[8];
+};
+
+// element types: the payload carries a sequence number to check the sum.
+template <typename T>
+struct element;
+
+template <>
+struct element<int> {
+  static constexpr const char* name = "int";
+  static int make(uint64_t seq) {
+    return static_cast<int>(seq);
+  }
+  static uint64_t consume(int& v) {
+    return static_cast<uint64_t>(v);
+  }
+};
+
+template <>
+struct element<line64> {
+  static constexpr const char* name = "64B";
+  static line64 make(uint64_t seq) {
+    line64 v;
+    std::fill(std::begin(v.words), std::end(v.words), seq);
+    return v;
+  }
+  static uint64_t consume(line64& v) {
+    return v.words[0];
+  }
+};
+
+// a small closure, as a threadpool task would be; run by the consumer.
+thread_local uint64_t consumed = 0;
+
+template <>
+struct element<std::function<void()>> {
+  static constexpr const char* name = "function";
+  static std::function<void()> make(uint64_t seq) {
+    return [seq]() { consumed += seq; };
+  }
+  static uint64_t consume(std::function<void()>& v) {
+    const uint64_t before = consumed;
+    v();
+    return consumed - before;
+  }
+};
+
+// `burst` elements back to back, then `gap` of silence.
+struct pattern {
+  const char* name;
+  int burst;
+  std::chrono::microseconds gap;
+};
+
+const pattern PATTERNS[] = {
+    {"steady", 0, std::chrono::microseconds(0)},
+    {"burst64", 64, std::chrono::microseconds(20)},
+    {"burst1k", 1024, std::chrono::microseconds(200)},
+};
+
+const int THREADS[] = {1, 4, 16};
+
+#if defined(__linux__)
+std::vector<int> allowed_cpus() {
+  std::vector<int> res;
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int i = 0; i != CPU_SETSIZE; ++i) {
+      if (CPU_ISSET(i, &set)) {
+        res.push_back(i);
+      }
+    }
+  }
+  return res;
+}
+
+void pin(std::thread& t, int index) {
+  static const std::vector<int> cpus = allowed_cpus();
+  if (cpus.empty()) {
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpus[index % cpus.size()], &set);
+  pthread_setaffinity_np(t.native_handle(), sizeof(set), &set);
+}
+
+// Cache misses of this thread and the threads it starts afterwards; -1 if
+// the kernel does not let us count them.
+class cache_misses {
+ public:
+  cache_misses() {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    if (fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+  ~cache_misses() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+  cache_misses(const cache_misses&) = delete;
+  cache_misses& operator=(const cache_misses&) = delete;
+
+  // counts of threads that have exited are included; join them first.
+  int64_t read() const {
+    uint64_t value = 0;
+    if (fd_ < 0 || ::read(fd_, &value, sizeof(value)) != sizeof(value)) {
+      return -1;
+    }
+    return static_cast<int64_t>(value);
+  }
+
+ private:
+  int fd_{-1};
+};
+#else
+void pin(std::thread&, int) {
+}
+
+class cache_misses {
+ public:
+  int64_t read() const {
+    return -1;
+  }
+};
+#endif
+
+// the queues' push flavours: `spsc_queue` is bounded and may refuse.
+template <typename Queue, typename T>
+void push(Queue& q, T&& v) {
+  if constexpr (std::is_same_v<decltype(q.push(std::move(v))), bool>) {
+    while (!q.push(std::move(v))) {
+      std::this_thread::yield();
+    }
+  } else {
+    q.emplace(std::move(v));
+  }
+}
+
+struct result {
+  double mops;
+  std::vector<int64_t> push_ns;
+  std::vector<int64_t> pop_ns;
+  int64_t misses;
+  bool ok;
+};
+
+const int SAMPLE_EVERY = 16;
+
+template <typename T, typename Queue>
+result run(Queue& q, int producers, int consumers, const pattern& pat,
+           uint64_t ops) {
+  using E = element<T>;
+  const uint64_t per_producer = ops / producers;
+  std::atomic<int> ready{0};
+  std::atomic<bool> go{false};
+  std::atomic<bool> produced{false};
+  std::vector<std::vector<int64_t>> push_ns(producers), pop_ns(consumers);
+  std::vector<uint64_t> sums(consumers, 0), counts(consumers, 0);
+  std::vector<steady::time_point> ends(consumers);
+  const int threads = producers + consumers;
+
+  auto wait_for_go = [&]() {
+    ready.fetch_add(1);
+    while (!go.load(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+  };
+
+  cache_misses counter;
+  std::vector<std::thread> ps, cs;
+  for (int p = 0; p != producers; ++p) {
+    ps.emplace_back([&, p]() {
+      auto& lat = push_ns[p];
+      lat.reserve(per_producer / SAMPLE_EVERY + 1);
+      wait_for_go();
+      for (uint64_t i = 0; i != per_producer; ++i) {
+        T v = E::make(p * per_producer + i);
+        if (i % SAMPLE_EVERY == 0) {
+          auto start = steady::now();
+          push(q, std::move(v));
+          lat.push_back(nanos(steady::now() - start));
+        } else {
+          push(q, std::move(v));
+        }
+        if (pat.burst != 0 && (i + 1) % pat.burst == 0) {
+          auto until = steady::now() + pat.gap;
+          while (steady::now() < until) {
+          }
+        }
+      }
+    });
+    pin(ps.back(), p);
+  }
+  for (int c = 0; c != consumers; ++c) {
+    cs.emplace_back([&, c]() {
+      auto& lat = pop_ns[c];
+      lat.reserve(ops / consumers / SAMPLE_EVERY + 1);
+      uint64_t sum = 0, count = 0;
+      T holder;
+      wait_for_go();
+      for (;;) {
+        bool popped;
+        if (count % SAMPLE_EVERY == 0) {
+          auto start = steady::now();
+          popped = q.pop(holder);
+          if (popped) {
+            lat.push_back(nanos(steady::now() - start));
+          }
+        } else {
+          popped = q.pop(holder);
+        }
+        if (popped) {
+          sum += E::consume(holder);
+          ++count;
+        } else if (produced.load(std::memory_order_acquire)) {
+          // every push has completed: a failed pop means drained.
+          if (!q.pop(holder)) {
+            break;
+          }
+          sum += E::consume(holder);
+          ++count;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+      ends[c] = steady::now();
+      sums[c] = sum;
+      counts[c] = count;
+    });
+    pin(cs.back(), producers + c);
+  }
+
+  while (ready.load() != threads) {
+    std::this_thread::yield();
+  }
+  const auto start = steady::now();
+  go.store(true, std::memory_order_release);
+  for (auto& t : ps) {
+    t.join();
+  }
+  produced.store(true, std::memory_order_release);
+  for (auto& t : cs) {
+    t.join();
+  }
+
+  result res;
+  const uint64_t total = per_producer * producers;
+  uint64_t sum = 0, count = 0;
+  for (int c = 0; c != consumers; ++c) {
+    sum += sums[c];
+    count += counts[c];
+  }
+  res.ok = count == total && sum == total * (total - 1) / 2;
+  const auto end = *std::max_element(ends.begin(), ends.end());
+  res.mops = total / std::chrono::duration<double, std::micro>(end - start)
+                         .count();
+  for (auto& v : push_ns) {
+    res.push_ns.insert(res.push_ns.end(), v.begin(), v.end());
+  }
+  for (auto& v : pop_ns) {
+    res.pop_ns.insert(res.pop_ns.end(), v.begin(), v.end());
+  }
+  res.misses = counter.read();
+  return res;
+}
+
+int64_t percentile(std::vector<int64_t>& v, double p) {
+  if (v.empty()) {
+    return 0;
+  }
+  const size_t k = std::min(v.size() - 1, static_cast<size_t>(p * v.size()));
+  std::nth_element(v.begin(), v.begin() + k, v.end());
+  return v[k];
+}
+
+void report(const char* queue, const char* type, const pattern& pat,
+            int producers, int consumers, uint64_t ops, result& res) {
+  char misses[32] = "n/a";
+  if (res.misses >= 0) {
+    std::snprintf(misses, sizeof(misses), "%.2f",
+                  static_cast<double>(res.misses) / ops);
+  }
+  std::printf(
+      "%-16s %-9s %-8s %3dP %3dC %9.2f %7lld %7lld %7lld %7lld %7lld %7lld "
+      "%9s%s\n",
+      queue, type, pat.name, producers, consumers, res.mops,
+      static_cast<long long>(percentile(res.push_ns, 0.5)),
+      static_cast<long long>(percentile(res.push_ns, 0.99)),
+      static_cast<long long>(percentile(res.push_ns, 0.999)),
+      static_cast<long long>(percentile(res.pop_ns, 0.5)),
+      static_cast<long long>(percentile(res.pop_ns, 0.99)),
+      static_cast<long long>(percentile(res.pop_ns, 0.999)), misses,
+      res.ok ? "" : "  LOST ELEMENTS");
+  std::fflush(stdout);
+}
+
+template <typename T, template <typename...> class Queue>
+void sweep(const char* queue, uint64_t ops) {
+  for (const pattern& pat : PATTERNS) {
+    for (int producers : THREADS) {
+      for (int consumers : THREADS) {
+        Queue<T> q;
+        const uint64_t total = ops / producers * producers;
+        result res = run<T>(q, producers, consumers, pat, total);
+        report(queue, element<T>::name, pat, producers, consumers, total, res);
+      }
+    }
+  }
+}
+
+template <typename T>
+using spsc = yuuki::spsc_queue<T>;
+
+// single producer and consumer only.
+template <typename T>
+void sweep_spsc(uint64_t ops) {
+  for (const pattern& pat : PATTERNS) {
+    spsc<T> q(4096);
+    result res = run<T>(q, 1, 1, pat, ops);
+    report("spsc_queue", element<T>::name, pat, 1, 1, ops, res);
+  }
+}
+
+template <typename T>
+void sweep_all(const std::vector<std::string>& queues, uint64_t ops) {
+  auto wanted = [&queues](const char* name) {
+    return queues.empty() ||
+           std::find(queues.begin(), queues.end(), name) != queues.end();
+  };
+  if (wanted("threadsafe_queue")) {
+    sweep<T, yuuki::threadsafe_queue>("threadsafe_queue", ops);
+  }
+  if (wanted("blocking_queue")) {
+    sweep<T, yuuki::blocking_queue>("blocking_queue", ops);
+  }
+  if (wanted("lockfree_queue")) {
+    sweep<T, yuuki::lockfree_queue>("lockfree_queue", ops);
+  }
+  if (wanted("spsc_queue")) {
+    sweep_spsc<T>(ops);
+  }
+}
+
+int main(int argc, char** argv) {
+  uint64_t ops = 1 << 18;
+  std::vector<std::string> queues;
+  for (int i = 1; i != argc; ++i) {
+    if (std::strncmp(argv[i], "--ops=", 6) == 0) {
+      ops = std::strtoull(argv[i] + 6, nullptr, 10);
+    } else {
+      queues.emplace_back(argv[i]);
+    }
+  }
+  std::printf(
+      "%-16s %-9s %-8s %4s %4s %9s %7s %7s %7s %7s %7s %7s %9s\n", "queue",
+      "element", "pattern", "prod", "cons", "Mops/s", "push50", "push99",
+      "push999", "pop50", "pop99", "pop999", "miss/op");
+  sweep_all<int>(queues, ops);
+  sweep_all<line64>(queues, ops);
+  sweep_all<std::function<void()>>(queues, ops);
+  return 0;
+}
@@ -0,0 +1,115 @@
+// =========================================================================
+// Copyright 2021 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#include <catch.h>
+#include <yuuki/task_graph.h>
+#include <yuuki/threadpool.h>
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Shapes of 100k nodes, each node doing a sliver of work. Every shape is run
+// through `yuuki::task_graph` and through the "wait on the predecessors'
+// futures inside the task" idiom it replaces.
+const int NUM = 100000;
+
+using edges_t = std::vector<std::pair<int, int>>;
+
+edges_t wide() {  // one root fanning out to everything, joined at the end
+  edges_t edges;
+  for (int i = 1; i != NUM - 1; ++i) {
+    edges.emplace_back(0, i);
+    edges.emplace_back(i, NUM - 1);
+  }
+  return edges;
+}
+
+edges_t deep() {  // a single chain
+  edges_t edges;
+  for (int i = 1; i != NUM; ++i) {
+    edges.emplace_back(i - 1, i);
+  }
+  return edges;
+}
+
+edges_t random_dag() {  // up to 3 random predecessors among the prior nodes
+  std::default_random_engine eng(42);
+  edges_t edges;
+  for (int i = 1; i != NUM; ++i) {
+    for (int k = 0; k != 3; ++k) {
+      edges.emplace_back(std::uniform_int_distribution<int>(0, i - 1)(eng), i);
+    }
+  }
+  return edges;
+}
+
+void work(std::atomic<uint64_t>& sink, int i) {
+  uint64_t x = i;
+  for (int k = 0; k != 64; ++k) x = x * 6364136223846793005ULL + 1;
+  sink.fetch_add(x, std::memory_order_relaxed);
+}
+
+template <typename Pool>
+void bench_shape(const char* name, const Pool& pool, const edges_t& edges) {
+  std::atomic<uint64_t> sink{0};
+
+  yuuki::task_graph g;
+  for (int i = 0; i != NUM; ++i) {
+    g.emplace([&sink, i]() { work(sink, i); });
+  }
+  for (auto& e : edges) {
+    g.precede(e.first, e.second);
+  }
+  BENCHMARK(std::string(name) + " - task_graph") {
+    return g.run(pool);
+  };
+
+  std::vector<std::vector<int>> preds(NUM);
+  for (auto& e : edges) {
+    preds[e.second].push_back(e.first);
+  }
+  BENCHMARK(std::string(name) + " - fut.get() in workers") {
+    // submitted in topological order, so the FIFO pool cannot deadlock.
+    std::vector<std::shared_future<void>> futs(NUM);
+    for (int i = 0; i != NUM; ++i) {
+      std::vector<std::shared_future<void>> deps;
+      for (int p : preds[i]) deps.push_back(futs[p]);
+      auto node = [&sink, i](std::vector<std::shared_future<void>>& deps) {
+        for (auto& dep : deps) dep.get();
+        work(sink, i);
+      };
+      futs[i] = pool.async(node, std::move(deps)).share();
+    }
+    futs.back().get();
+    for (auto& fut : futs) fut.get();
+    return;
+  };
+}
+
+TEST_CASE("task_graph - benchmark") {
+  yuuki::threadpool pool;
+  pool.init(std::thread::hardware_concurrency());
+  bench_shape("wide", pool, wide());
+  bench_shape("deep", pool, deep());
+  bench_shape("random", pool, random_dag());
+}
@@ -20,8 +20,14 @@
 #include <yuuki/threadpool.h>
 #include <yuuki/threadsafe_queue.h>
 
+#include <chrono>
 #include <cstdint>
+#include <functional>
 #include <future>
+#include <memory_resource>
+#include <string>
+#include <thread>
+#include <vector>
 
 std::uint64_t Fibonacci(std::uint64_t number) {
   return number < 2 ? 1 : Fibonacci(number - 1) + Fibonacci(number - 2);
@@ -70,3 +76,112 @@ TEST_CASE("threadpool - benchmark") {
     return;
   };
 }
+
+// Many producers hammering `async()` with trivial tasks: dominated by the
+// submission path rather than by the work itself.
+template <typename Pool>
+void multi_producer_submit(const Pool& pool, int producers, int num) {
+  std::vector<std::thread> threads;
+  threads.reserve(producers);
+  for (int p = 0; p != producers; ++p) {
+    threads.emplace_back([&pool, producers, num]() {
+      std::vector<std::future<int>> futs;
+      futs.reserve(num / producers);
+      for (int i = 0; i != num / producers; ++i) {
+        futs.emplace_back(pool.async([](int i) -> int { return i; }, i));
+      }
+      for (auto& fut : futs) {
+        fut.get();
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+TEST_CASE("threadpool - multi-producer submit") {
+  const int NUM = 1 << 16;
+
+  yuuki::threadpool<yuuki::blocking_queue<std::function<void()>>> b_queue;
+  b_queue.init(std::thread::hardware_concurrency());
+  yuuki::threadpool<yuuki::threadsafe_queue<std::function<void()>>> ts_queue;
+  ts_queue.init(std::thread::hardware_concurrency());
+  // contention on the submission path only shows with several CPUs.
+  for (int producers : {1, 4, 16}) {
+    const std::string n = std::to_string(producers) + " producers";
+    BENCHMARK("b_queue.async, " + n) {
+      return multi_producer_submit(b_queue, producers, NUM);
+    };
+    BENCHMARK("ts_queue.async, " + n) {
+      return multi_producer_submit(ts_queue, producers, NUM);
+    };
+  }
+}
+
+TEST_CASE("threadpool - memory resource") {
+  const int NUM = 1 << 14;
+  auto submit = [NUM](const auto& pool) -> void {
+    std::vector<std::future<int>> futs;
+    futs.reserve(NUM);
+    for (int i = 0; i != NUM; ++i) {
+      futs.emplace_back(pool.async([](int i) -> int { return i; }, i));
+    }
+    for (auto& fut : futs) {
+      fut.get();
+    }
+  };
+
+  yuuki::threadpool<> heap;
+  heap.init(std::thread::hardware_concurrency());
+  BENCHMARK("default heap") {
+    return submit(heap);
+  };
+
+  std::pmr::synchronized_pool_resource resource;
+  yuuki::pmr::threadpool<> pooled(&resource);
+  pooled.init(std::thread::hardware_concurrency());
+  BENCHMARK("synchronized_pool_resource") {
+    return submit(pooled);
+  };
+}
+
+// CPU tasks mixed with tasks that sleep (think synchronous RPCs). A sleeping
+// worker is lost to the pool unless it sleeps inside a `blocking_scope`.
+TEST_CASE("threadpool - blocking tasks") {
+  const int CPU = 2000, SLEEPY = 64;
+  auto spin = []() -> void {
+    auto until =
+        std::chrono::steady_clock::now() + std::chrono::microseconds(5);
+    while (std::chrono::steady_clock::now() < until) {
+    }
+  };
+  auto mix = [&spin, CPU, SLEEPY](const auto& pool, bool managed) -> void {
+    std::vector<std::future<void>> futs;
+    futs.reserve(CPU + SLEEPY);
+    for (int i = 0; i != CPU + SLEEPY; ++i) {
+      if (i % ((CPU + SLEEPY) / SLEEPY) == 0) {
+        futs.emplace_back(pool.async([&pool, managed]() -> void {
+          auto nap = []() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+          };
+          managed ? pool.run_blocking(nap) : nap();
+        }));
+      } else {
+        futs.emplace_back(pool.async(spin));
+      }
+    }
+    for (auto& fut : futs) {
+      fut.get();
+    }
+  };
+
+  yuuki::threadpool<> pool;
+  pool.init(4, 12);
+  BENCHMARK("plain sleep") {
+    return mix(pool, false);
+  };
+  BENCHMARK("run_blocking") {
+    return mix(pool, true);
+  };
+}
@@ -0,0 +1,140 @@
+// =========================================================================
+// Copyright 2021 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+// `free()` of what our `operator new` took from `malloc()` is fine.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+#include <catch.h>
+#include <yuuki/threadpool.h>
+#include <yuuki/worker_local.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+// every call of the global `operator new`, from any thread.
+std::atomic<uint64_t> heap_allocations{0};
+
+void* operator new(std::size_t size) {
+  heap_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+const int TASKS = 2048;
+const int ITEMS = 1024;
+
+// A buffer-heavy task: collects the odd values of its slice of the input in
+// a temporary grown element by element, then histograms them in another.
+template <typename Vector>
+uint64_t work(const std::vector<uint32_t>& input, int task, Vector& items,
+              Vector& histogram) {
+  items.clear();
+  for (int i = task * ITEMS; i != (task + 1) * ITEMS; ++i) {
+    if (input[i] & 1) {
+      items.push_back(input[i]);
+    }
+  }
+  histogram.assign(256, 0);
+  for (uint32_t v : items) {
+    ++histogram[v >> 24];
+  }
+  return items.size() + histogram[0];
+}
+
+template <typename Task>
+uint64_t run_all(const yuuki::threadpool<>& pool, Task task) {
+  std::vector<std::future<uint64_t>> futs;
+  futs.reserve(TASKS);
+  for (int t = 0; t != TASKS; ++t) {
+    futs.push_back(pool.async(task, t));
+  }
+  uint64_t res = 0;
+  for (auto& fut : futs) {
+    res += fut.get();
+  }
+  return res;
+}
+
+TEST_CASE("worker_local - buffer-heavy tasks") {
+  yuuki::threadpool<> pool;
+  pool.init(4);
+  std::vector<uint32_t> input(TASKS * ITEMS);
+  uint32_t x = 42;
+  for (auto& v : input) {
+    x = x * 1664525U + 1013904223U;
+    v = x;
+  }
+
+  auto heap = [&input](int t) {
+    std::vector<uint32_t> items, histogram;
+    return work(input, t, items, histogram);
+  };
+  auto scratch = [&input](int t) {
+    std::pmr::vector<uint32_t> items(yuuki::worker_scratch());
+    std::pmr::vector<uint32_t> histogram(yuuki::worker_scratch());
+    return work(input, t, items, histogram);
+  };
+  struct buffers {
+    std::vector<uint32_t> items, histogram;
+  };
+  yuuki::worker_local<buffers> local(pool);
+  auto reused = [&input, &local](int t) {
+    buffers& b = local.local();
+    return work(input, t, b.items, b.histogram);
+  };
+
+  // allocations per task once warmed up; those of `async()` itself included.
+  auto per_task = [&pool](auto task) {
+    run_all(pool, task);
+    const uint64_t before = heap_allocations.load();
+    run_all(pool, task);
+    return static_cast<double>(heap_allocations.load() - before) / TASKS;
+  };
+  std::printf("heap allocations per task (async overhead included):\n");
+  std::printf("  std::vector:          %6.2f\n", per_task(heap));
+  std::printf("  worker_scratch():     %6.2f\n", per_task(scratch));
+  std::printf("  worker_local buffers: %6.2f\n", per_task(reused));
+
+  BENCHMARK("std::vector") {
+    return run_all(pool, heap);
+  };
+  BENCHMARK("worker_scratch()") {
+    return run_all(pool, scratch);
+  };
+  BENCHMARK("worker_local buffers") {
+    return run_all(pool, reused);
+  };
+}
@@ -20,6 +20,7 @@
 
 #include <cstdint>
 #include <future>
+#include <memory_resource>
 #include <vector>
 
 TEST_CASE("single-thread usage") {
@@ -56,3 +57,20 @@ TEST_CASE("multiple-thread usage") {
     REQUIRE(holder < 42UL);
   }
 }
+
+TEST_CASE("memory resource") {
+  std::pmr::monotonic_buffer_resource upstream;
+  std::pmr::unsynchronized_pool_resource pool(&upstream);
+  yuuki::pmr::blocking_queue<uint64_t> q(&pool);
+  REQUIRE(q.get_allocator().resource() == &pool);
+  for (uint64_t i = 0; i != 42UL; ++i) {
+    q.push(i);
+  }
+  REQUIRE(q.size() == 42);
+  for (uint64_t i = 0; i != 42UL; ++i) {
+    uint64_t holder;
+    REQUIRE(q.pop(holder));
+    REQUIRE(holder == i);
+  }
+  REQUIRE(q.empty());
+}
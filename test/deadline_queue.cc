@@ -0,0 +1,110 @@
+// =========================================================================
+// Copyright 2021 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#include <catch.h>
+#include <yuuki/deadline_queue.h>
+
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("single-thread usage") {
+  // the order holds however many shards the tasks are spread over.
+  for (size_t shards : {1, 4}) {
+    yuuki::deadline_queue<> q(std::allocator<yuuki::deadline_task>(), shards);
+    REQUIRE(q.empty());
+    auto now = yuuki::deadline_clock::now();
+    std::vector<int> order;
+    q.emplace([&order]() { order.push_back(-1); });  // no deadline: served last
+    for (int i : {3, 1, 4, 0, 2}) {
+      q.emplace(now + i * 1ms, [&order, i]() { order.push_back(i); });
+    }
+    q.emplace(now + 1ms, [&order]() { order.push_back(10); });  // FIFO on ties
+    REQUIRE(q.size() == 7);
+    yuuki::deadline_task task;
+    while (q.pop(task)) {
+      task();
+    }
+    REQUIRE(q.empty());
+    REQUIRE(order == std::vector<int>{0, 1, 10, 2, 3, 4, -1});
+    q.emplace(now, []() {});
+    q.clear();
+    REQUIRE(q.empty());
+    REQUIRE_FALSE(q.pop(task));
+  }
+}
+
+TEST_CASE("threadpool - earliest deadline first") {
+  yuuki::deadline_threadpool pool;
+  pool.init(1);
+  std::promise<void> started, gate;
+  auto blocker = pool.async([&started, &gate]() {
+    started.set_value();
+    gate.get_future().wait();
+  });
+  // the blocker has no deadline: once queued, it would be served last.
+  started.get_future().wait();
+  auto now = yuuki::deadline_clock::now();
+  std::vector<int> order;
+  std::vector<std::future<void>> futs;
+  for (int i = 9; i >= 0; --i) {
+    futs.emplace_back(yuuki::async_with_deadline(
+        pool, now + 1s + i * 1ms, [&order](int i) { order.push_back(i); }, i));
+  }
+  gate.set_value();
+  blocker.get();
+  for (auto& fut : futs) {
+    fut.get();
+  }
+  REQUIRE(order == std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9});
+}
+
+TEST_CASE("threadpool - skip expired") {
+  yuuki::deadline_threadpool pool;
+  pool.init(1);
+  auto past = yuuki::deadline_clock::now() - 1ms;
+  auto skipped = yuuki::async_with_deadline(pool, past, yuuki::skip_expired,
+                                            []() -> int { return 42; });
+  auto kept =
+      yuuki::async_with_deadline(pool, past, []() -> int { return 42; });
+  auto fresh = yuuki::async_with_deadline(
+      pool, yuuki::deadline_clock::now() + 1h, yuuki::skip_expired,
+      []() -> int { return 42; });
+  try {
+    skipped.get();
+    FAIL("an expired task has run");
+  } catch (const std::system_error& e) {
+    REQUIRE(e.code() == std::errc::timed_out);
+  }
+  REQUIRE(kept.get() == 42);
+  REQUIRE(fresh.get() == 42);
+}
+
+TEST_CASE("threadpool - refuses once stopped") {
+  yuuki::deadline_threadpool pool;
+  pool.init(1);
+  REQUIRE(pool.accepting());
+  pool.terminate();
+  REQUIRE_FALSE(pool.accepting());
+  REQUIRE_THROWS_AS(yuuki::async_with_deadline(
+                        pool, yuuki::deadline_clock::now(), []() {}),
+                    std::runtime_error);
+}
@@ -0,0 +1,213 @@
+// =========================================================================
+// Copyright 2021 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#include <catch.h>
+#include <yuuki/default_pool.h>
+#include <yuuki/threadpool.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("default concurrency") {
+  const int n = yuuki::default_concurrency();
+  REQUIRE(n >= 1);
+  REQUIRE(n <= static_cast<int>(
+                   std::max(std::thread::hardware_concurrency(), 1U)));
+}
+
+TEST_CASE("threadpool - lazy start") {
+  yuuki::threadpool<> pool;
+  pool.init_lazily(4);
+  REQUIRE(pool.is_running());
+  REQUIRE(pool.size() == 0);
+  REQUIRE(pool.async([]() { return 1; }).get() == 1);
+  REQUIRE(pool.size() >= 1);
+
+  // eight tasks that all wait for each other's start need every worker, but
+  // the pool does not grow beyond four.
+  std::promise<void> gate;
+  std::shared_future<void> opened = gate.get_future().share();
+  std::atomic<int> started{0};
+  std::vector<std::future<void>> futs;
+  for (int i = 0; i != 8; ++i) {
+    futs.push_back(pool.async([&started, opened]() {
+      ++started;
+      opened.wait();
+    }));
+  }
+  while (started < 4) {
+    std::this_thread::sleep_for(1ms);
+  }
+  REQUIRE(pool.size() == 4);
+  gate.set_value();
+  for (auto& fut : futs) {
+    fut.get();
+  }
+  REQUIRE(started == 8);
+  REQUIRE(pool.size() == 4);
+}
+
+TEST_CASE("threadpool - lazy start under a burst") {
+  // The one started worker is parked; a burst of tasks that wait for each
+  // other is queued before it wakes up, so every submitter sees an idle
+  // worker. The pool must still start the workers it owes. Spinning hogs keep
+  // the woken worker off the CPU for as long as possible.
+  struct cpu_hogs {
+    std::atomic<bool> done{false};
+    std::vector<std::thread> threads;
+    ~cpu_hogs() {
+      done = true;
+      for (auto& t : threads) {
+        t.join();
+      }
+    }
+  } hogs;
+  for (unsigned i = 0; i != std::max(std::thread::hardware_concurrency(), 1U);
+       ++i) {
+    hogs.threads.emplace_back([&hogs]() {
+      while (!hogs.done.load(std::memory_order_relaxed)) {
+      }
+    });
+  }
+  for (int round = 0; round != 20; ++round) {
+    yuuki::threadpool<> pool;
+    pool.init_lazily(4);
+    pool.async([]() {}).get();
+    std::atomic<int> started{0};
+    std::vector<std::future<bool>> futs;
+    for (int i = 0; i != 4; ++i) {
+      futs.push_back(pool.async([&started]() {
+        ++started;
+        // gives up rather than hanging the test.
+        auto until = std::chrono::steady_clock::now() + 2s;
+        while (started < 4 && std::chrono::steady_clock::now() < until) {
+          std::this_thread::sleep_for(1ms);
+        }
+        return started >= 4;
+      }));
+    }
+    for (auto& fut : futs) {
+      REQUIRE(fut.get());
+    }
+  }
+}
+
+TEST_CASE("default pool") {
+  auto& pool = yuuki::default_pool();
+  REQUIRE(&pool == &yuuki::default_pool());
+  REQUIRE(pool.is_running());
+  REQUIRE(pool.async([](int i) { return i * 2; }, 21).get() == 42);
+  REQUIRE(pool.size() <= yuuki::default_concurrency());
+}
+
+TEST_CASE("executor - limit") {
+  yuuki::threadpool<> pool;
+  pool.init(8);
+  yuuki::executor<yuuki::threadpool<>> ex(pool, 2);
+  auto copy = ex;  // shares the limit
+  REQUIRE(copy.max_concurrency() == 2);
+  REQUIRE(&copy.pool() == &pool);
+  REQUIRE_THROWS_AS(yuuki::executor<yuuki::threadpool<>>(pool, 0),
+                    std::invalid_argument);
+  std::atomic<int> running{0}, peak{0}, others{0};
+  std::vector<std::future<int>> futs;
+  for (int i = 0; i != 32; ++i) {
+    futs.push_back((i % 2 ? ex : copy).async([&running, &peak](int i) {
+      int now = ++running;
+      int prev = peak.load();
+      while (now > prev && !peak.compare_exchange_weak(prev, now)) {
+      }
+      std::this_thread::sleep_for(1ms);
+      --running;
+      return i;
+    }, i));
+  }
+  // the pool itself is not held up by the view.
+  REQUIRE(pool.async([&others]() { return ++others; }).get() == 1);
+  for (int i = 0; i != 32; ++i) {
+    REQUIRE(futs[i].get() == i);
+  }
+  REQUIRE(peak <= 2);
+}
+
+TEST_CASE("executor - stopped pool") {
+  yuuki::threadpool<> pool;
+  pool.init(1);
+  auto ex = yuuki::executor<yuuki::threadpool<>>(pool, 1);
+  std::promise<void> gate;
+  auto first = ex.async([&gate]() { gate.get_future().wait(); });
+  auto waiting = ex.async([]() { return 1; });  // held in the view
+  std::thread stopper([&pool]() { pool.terminate(); });
+  // the view must only hand `waiting` on once the pool refuses it.
+  while (pool.is_running()) {
+    std::this_thread::sleep_for(1ms);
+  }
+  gate.set_value();
+  stopper.join();
+  first.get();
+  REQUIRE_THROWS_AS(waiting.get(), std::future_error);
+  REQUIRE_THROWS_AS(ex.async([]() {}), std::runtime_error);
+
+  auto unlimited = yuuki::make_executor();
+  REQUIRE(&unlimited.pool() == &yuuki::default_pool());
+  REQUIRE(unlimited.async([]() { return 3; }).get() == 3);
+}
+
+// forwards to a real pool, but fails to take the `fail_at`th task.
+struct flaky_pool {
+  yuuki::threadpool<>& pool;
+  int fail_at;
+  mutable std::atomic<int> posts{0};
+
+  auto get_allocator() const {
+    return pool.get_allocator();
+  }
+  void check_accepting() const {
+    pool.check_accepting();
+  }
+  template <class F>
+  void post(F&& f) const {
+    if (++posts == fail_at) {
+      throw std::bad_alloc();
+    }
+    pool.post(std::forward<F>(f));
+  }
+};
+
+TEST_CASE("executor - a task the pool cannot take") {
+  yuuki::threadpool<> pool;
+  pool.init(2);
+  flaky_pool flaky{pool, 2};
+  yuuki::executor<flaky_pool> ex(flaky, 1);
+  std::promise<void> gate;
+  auto first = ex.async([&gate]() { gate.get_future().wait(); });
+  auto lost = ex.async([]() { return 2; });  // its hand-over fails
+  auto third = ex.async([]() { return 3; });
+  gate.set_value();
+  first.get();
+  REQUIRE_THROWS_AS(lost.get(), std::future_error);
+  REQUIRE(third.get() == 3);
+  // the slot was not leaked.
+  REQUIRE(ex.async([]() { return 4; }).get() == 4);
+}
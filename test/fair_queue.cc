@@ -0,0 +1,166 @@
+// =========================================================================
+// Copyright 2021 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#include <catch.h>
+#include <yuuki/fair_queue.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("single-thread usage") {
+  yuuki::fair_queue<> q;
+  REQUIRE(q.empty());
+  auto* a = q.add_tenant(2);
+  auto* b = q.add_tenant(1);
+  REQUIRE(a->weight == 2);
+  REQUIRE_THROWS_AS(q.add_tenant(0), std::invalid_argument);
+  REQUIRE_THROWS_AS(q.add_tenant(1, 0), std::invalid_argument);
+
+  std::string order;
+  for (int i = 0; i != 6; ++i) {
+    q.emplace(a, [&order] { order += 'a'; });
+  }
+  for (int i = 0; i != 3; ++i) {
+    q.emplace(b, [&order] { order += 'b'; });
+  }
+  q.emplace([&order] { order += 'd'; });  // default tenant
+  REQUIRE(q.size() == 10);
+  yuuki::tenant_task task;
+  while (q.pop(task)) {
+    task();
+  }
+  REQUIRE(q.empty());
+  REQUIRE(order == "aabdaabaab");
+
+  q.emplace(a, [] {});
+  q.emplace([] {});
+  q.clear();
+  REQUIRE(q.empty());
+  REQUIRE_FALSE(q.pop(task));
+}
+
+TEST_CASE("tenants at their cap are not runnable") {
+  yuuki::fair_queue<> q;
+  auto* t = q.add_tenant(1, 1);
+  q.emplace(t, [] {});
+  q.emplace(t, [] {});
+  yuuki::tenant_task running;
+  REQUIRE(q.pop(running));
+  // a task is pending, but nobody could pop it.
+  REQUIRE(q.size() == 1);
+  REQUIRE(q.empty());
+  yuuki::tenant_task task;
+  REQUIRE_FALSE(q.pop(task));
+  running();
+  REQUIRE_FALSE(q.empty());
+  REQUIRE(q.pop(task));
+}
+
+TEST_CASE("threadpool - weights share the workers") {
+  yuuki::fair_threadpool pool;
+  pool.init(1);
+  std::promise<void> gate;
+  auto blocker = pool.async([&gate]() { gate.get_future().wait(); });
+  auto heavy = pool.make_tenant(3);
+  auto light = pool.make_tenant(1);
+  std::string order;
+  std::vector<std::future<void>> futs;
+  for (int i = 0; i != 8; ++i) {
+    futs.push_back(light.async([&order] { order += 'l'; }));
+  }
+  for (int i = 0; i != 8; ++i) {
+    futs.push_back(heavy.async([&order] { order += 'h'; }));
+  }
+  gate.set_value();
+  for (auto& fut : futs) {
+    fut.get();
+  }
+  blocker.get();
+  // the light tenant queued first, yet gets one turn per three of the heavy.
+  REQUIRE(order.substr(0, 12) == "lhhhlhhhlhhl");
+}
+
+TEST_CASE("threadpool - concurrency cap") {
+  yuuki::fair_threadpool pool;
+  pool.init(8);
+  auto capped = pool.make_tenant(1, 2);
+  auto free = pool.make_tenant(1);
+  REQUIRE(capped.max_concurrency() == 2);
+  std::atomic<int> running{0}, peak{0}, others{0};
+  std::vector<std::future<void>> futs;
+  for (int i = 0; i != 64; ++i) {
+    futs.push_back(capped.async([&] {
+      int now = ++running;
+      int prev = peak.load();
+      while (now > prev && !peak.compare_exchange_weak(prev, now)) {
+      }
+      std::this_thread::sleep_for(1ms);
+      --running;
+    }));
+  }
+  for (int i = 0; i != 64; ++i) {
+    futs.push_back(free.async([&others] { ++others; }));
+  }
+  for (auto& fut : futs) {
+    fut.get();
+  }
+  REQUIRE(peak <= 2);
+  REQUIRE(peak >= 1);
+  REQUIRE(others == 64);
+}
+
+TEST_CASE("threadpool - many tenants come and go") {
+  // tenants keep draining, hitting their caps and rejoining the ring; a lost
+  // rejoin leaves tasks behind and hangs this.
+  yuuki::fair_threadpool pool;
+  pool.init(4);
+  std::vector<yuuki::tenant<yuuki::fair_threadpool>> tenants;
+  for (int i = 0; i != 32; ++i) {
+    tenants.push_back(pool.make_tenant(1 + i % 3, i % 4 == 0 ? 1 : 1 + i % 5));
+  }
+  std::atomic<int> ran{0};
+  std::vector<std::future<void>> futs;
+  for (int round = 0; round != 50; ++round) {
+    for (auto& t : tenants) {
+      futs.push_back(t.async([&ran] { ++ran; }));
+    }
+  }
+  for (auto& fut : futs) {
+    fut.get();
+  }
+  REQUIRE(ran == 32 * 50);
+}
+
+TEST_CASE("threadpool - exceptions and cancel") {
+  yuuki::fair_threadpool pool;
+  pool.init(2);
+  auto t = pool.make_tenant(1, 1);
+  auto fut = t.async([]() -> int { throw std::runtime_error("boom"); });
+  REQUIRE_THROWS_AS(fut.get(), std::runtime_error);
+  // the slot of the failed task was given back.
+  REQUIRE(t.async([] { return 42; }).get() == 42);
+  pool.cancel();
+  REQUIRE_THROWS_AS(t.async([] {}), std::runtime_error);
+}
@@ -0,0 +1,235 @@
+// =========================================================================
+// Copyright 2021 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#include <catch.h>
+#include <yuuki/io_service.h>
+#include <yuuki/threadpool.h>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <new>
+#include <set>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+using io_service = yuuki::io_service<yuuki::threadpool<>>;
+
+struct temp_file {
+  temp_file() {
+    char path[] = "/tmp/yuuki_io_service_XXXXXX";
+    fd = mkstemp(path);
+    unlink(path);
+  }
+  ~temp_file() {
+    close(fd);
+  }
+  int fd;
+};
+
+// the threads of a pool of `n` workers: `n` tasks that wait for each other
+// each need a worker of their own.
+std::set<std::thread::id> worker_ids(yuuki::threadpool<>& pool, int n) {
+  std::atomic<int> started{0};
+  std::vector<std::future<std::thread::id>> futs;
+  for (int i = 0; i != n; ++i) {
+    futs.push_back(pool.async([&started, n]() {
+      ++started;
+      while (started < n) {
+        std::this_thread::yield();
+      }
+      return std::this_thread::get_id();
+    }));
+  }
+  std::set<std::thread::id> ids;
+  for (auto& fut : futs) {
+    ids.insert(fut.get());
+  }
+  return ids;
+}
+
+void round_trip(io_service::backend preferred) {
+  yuuki::threadpool<> pool;
+  pool.init(4);
+  const auto workers = worker_ids(pool, 4);
+  REQUIRE(workers.size() == 4);
+  temp_file file;
+  REQUIRE(file.fd >= 0);
+  io_service io(pool, 16, preferred);
+  if (preferred == io_service::backend::threads) {
+    REQUIRE(io.get_backend() == io_service::backend::threads);
+  }
+
+  const size_t NUM = 64, LEN = 4096;
+  std::vector<char> out(NUM * LEN);
+  for (size_t i = 0; i != out.size(); ++i) {
+    out[i] = static_cast<char>(i * 7 + i / LEN);
+  }
+  std::vector<std::future<size_t>> futs;
+  {
+    io_service::batch b(io);
+    for (size_t i = 0; i != NUM; ++i) {
+      futs.push_back(io.write(file.fd, out.data() + i * LEN, LEN, i * LEN));
+    }
+  }
+  for (auto& fut : futs) {
+    REQUIRE(fut.get() == LEN);
+  }
+
+  std::vector<char> in(out.size());
+  futs.clear();
+  for (size_t i = NUM; i-- != 0;) {
+    futs.push_back(io.read(file.fd, in.data() + i * LEN, LEN, i * LEN));
+  }
+  for (auto& fut : futs) {
+    REQUIRE(fut.get() == LEN);
+  }
+  REQUIRE(in == out);
+
+  // callbacks run on the pool, not on the caller or the reactor.
+  std::atomic<size_t> bytes{0};
+  std::atomic<int> on_pool{0};
+  std::promise<void> all_done;
+  std::atomic<size_t> remaining{NUM};
+  std::vector<char> again(out.size());
+  for (size_t i = 0; i != NUM; ++i) {
+    auto done = [&](ssize_t res) noexcept {
+      bytes += res;
+      on_pool += workers.count(std::this_thread::get_id());
+      if (--remaining == 0) {
+        all_done.set_value();
+      }
+    };
+    io.read(file.fd, again.data() + i * LEN, LEN, i * LEN, done);
+  }
+  all_done.get_future().wait();
+  REQUIRE(bytes == out.size());
+  REQUIRE(on_pool == NUM);
+  REQUIRE(again == out);
+
+  // registered buffers
+  iovec iov{in.data(), in.size()};
+  io.register_buffers(&iov, 1);
+  std::fill(in.begin(), in.end(), 0);
+  REQUIRE(io.read_fixed(file.fd, 0, in.data() + LEN, LEN, LEN).get() == LEN);
+  REQUIRE(std::equal(in.begin() + LEN, in.begin() + 2 * LEN,
+                     out.begin() + LEN));
+  REQUIRE(io.write_fixed(file.fd, 0, in.data() + LEN, LEN, 0).get() == LEN);
+  REQUIRE(io.read(file.fd, again.data(), LEN, 0).get() == LEN);
+  REQUIRE(std::equal(again.begin(), again.begin() + LEN, out.begin() + LEN));
+
+  // short read at the end of the file, then errors.
+  REQUIRE(io.read(file.fd, in.data(), LEN, out.size() - 10).get() == 10);
+  REQUIRE_THROWS_AS(io.read(-1, in.data(), LEN, 0).get(), std::system_error);
+  std::promise<ssize_t> res;
+  io.read(-1, in.data(), LEN, 0,
+          [&res](ssize_t r) noexcept { res.set_value(r); });
+  REQUIRE(res.get_future().get() == -EBADF);
+  REQUIRE_THROWS_AS(io.read(file.fd, nullptr, size_t(UINT_MAX) + 1, 0),
+                    std::invalid_argument);
+
+  // once the pool has stopped, callbacks still run, on the reactor.
+  pool.terminate();
+  std::promise<bool> stopped;
+  const auto caller = std::this_thread::get_id();
+  io.read(file.fd, in.data(), LEN, 0,
+          [&stopped, &workers, caller](ssize_t r) noexcept {
+            const auto self = std::this_thread::get_id();
+            stopped.set_value(r == LEN && self != caller &&
+                              workers.count(self) == 0);
+          });
+  REQUIRE(stopped.get_future().get());
+}
+
+TEST_CASE("io_uring") {
+  round_trip(io_service::backend::io_uring);
+}
+
+TEST_CASE("thread fallback") {
+  round_trip(io_service::backend::threads);
+}
+
+TEST_CASE("queue depth bounds outstanding requests") {
+  // With the pool stopped, a callback runs before its request hands back its
+  // slot, so requests submitted but not yet called back are all in flight.
+  yuuki::threadpool<> pool;
+  pool.init(2);
+  pool.terminate();
+  temp_file file;
+  std::vector<char> buf(1 << 16, 'x');
+  REQUIRE(write(file.fd, buf.data(), buf.size()) ==
+          static_cast<ssize_t>(buf.size()));
+  const size_t DEPTH = 2, NUM = 256;
+  for (auto preferred :
+       {io_service::backend::io_uring, io_service::backend::threads}) {
+    io_service io(pool, DEPTH, preferred);
+    std::atomic<size_t> done{0}, ok{0};
+    size_t max_in_flight = 0;
+    {
+      io_service::batch b(io);  // a full queue must flush the batch itself
+      for (size_t i = 0; i != NUM; ++i) {
+        io.read(file.fd, buf.data() + i * 256, 256, i * 256,
+                [&done, &ok](ssize_t res) noexcept {
+                  ok += res == 256;
+                  ++done;
+                });
+        max_in_flight = std::max(max_in_flight, i + 1 - done.load());
+      }
+    }
+    while (done != NUM) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    REQUIRE(ok == NUM);
+    REQUIRE(max_in_flight >= 1);
+    REQUIRE(max_in_flight <= DEPTH);
+  }
+}
+
+// refuses every task, as a pool out of memory would.
+struct full_pool {
+  template <class F>
+  void post(F&&) const {
+    throw std::bad_alloc();
+  }
+};
+
+TEST_CASE("callbacks the pool cannot take run on the reactor") {
+  full_pool pool;
+  temp_file file;
+  char c = 'x';
+  REQUIRE(write(file.fd, &c, 1) == 1);
+  for (auto preferred : {yuuki::io_service<full_pool>::backend::io_uring,
+                         yuuki::io_service<full_pool>::backend::threads}) {
+    yuuki::io_service<full_pool> io(pool, 4, preferred);
+    std::promise<ssize_t> res;
+    char in = 0;
+    io.read(file.fd, &in, 1, 0,
+            [&res](ssize_t r) noexcept { res.set_value(r); });
+    REQUIRE(res.get_future().get() == 1);
+    REQUIRE(in == 'x');
+  }
+}
@@ -0,0 +1,202 @@
+// =========================================================================
+// Copyright 2021 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#include <catch.h>
+#include <yuuki/lockfree_queue.h>
+#include <yuuki/threadpool.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// counts live instances, to catch leaks and double destruction; negative
+// values refuse to be copied.
+struct tracked {
+  static std::atomic<int> live;
+  int value{0};
+  tracked() {
+    ++live;
+  }
+  explicit tracked(int v) : value(v) {
+    ++live;
+  }
+  tracked(const tracked& other) : value(other.value) {
+    if (value < 0) {
+      throw std::runtime_error("uncopyable");
+    }
+    ++live;
+  }
+  tracked& operator=(const tracked& other) = default;
+  ~tracked() {
+    --live;
+  }
+};
+std::atomic<int> tracked::live{0};
+
+TEST_CASE("single-thread usage") {
+  yuuki::lockfree_queue<std::string> q;
+  REQUIRE(q.empty());
+  std::string holder;
+  REQUIRE_FALSE(q.pop(holder));
+  // span several segments.
+  for (int i = 0; i != 5000; ++i) {
+    q.push(std::to_string(i));
+  }
+  REQUIRE_FALSE(q.empty());
+  for (int i = 0; i != 5000; ++i) {
+    REQUIRE(q.pop(holder));
+    REQUIRE(holder == std::to_string(i));
+  }
+  REQUIRE(q.empty());
+  REQUIRE_FALSE(q.pop(holder));
+  q.emplace(3, 'x');
+  REQUIRE(q.pop(holder));
+  REQUIRE(holder == "xxx");
+  q.push("a");
+  q.clear();
+  REQUIRE(q.empty());
+}
+
+TEST_CASE("no leaks") {
+  {
+    yuuki::lockfree_queue<tracked> q;
+    for (int i = 0; i != 3000; ++i) {
+      q.emplace(i);
+    }
+    tracked holder;
+    for (int i = 0; i != 1000; ++i) {
+      REQUIRE(q.pop(holder));
+      REQUIRE(holder.value == i);
+    }
+  }
+  REQUIRE(tracked::live == 0);
+}
+
+TEST_CASE("throwing push") {
+  {
+    yuuki::lockfree_queue<tracked> q;
+    tracked holder;
+    for (int i = 0; i != 1000; ++i) {
+      REQUIRE_THROWS_AS(q.emplace(-1), std::runtime_error);
+      REQUIRE_FALSE(q.pop(holder));
+      q.emplace(i);
+      REQUIRE(q.pop(holder));
+      REQUIRE(holder.value == i);
+    }
+    REQUIRE(q.empty());
+  }
+  REQUIRE(tracked::live == 0);
+}
+
+TEST_CASE("multi-producer multi-consumer stress") {
+  const int PRODUCERS = 4, CONSUMERS = 4, NUM = 20000;
+  yuuki::lockfree_queue<std::unique_ptr<int>> q;
+  std::atomic<int> done_producers{0};
+  std::vector<std::atomic<int>> seen(PRODUCERS * NUM);
+  std::vector<std::thread> threads;
+  for (int p = 0; p != PRODUCERS; ++p) {
+    threads.emplace_back([&q, &done_producers, p]() {
+      for (int i = 0; i != NUM; ++i) {
+        q.push(std::make_unique<int>(p * NUM + i));
+      }
+      ++done_producers;
+    });
+  }
+  std::vector<int> ordered(CONSUMERS, 1);
+  for (int c = 0; c != CONSUMERS; ++c) {
+    threads.emplace_back([&, c]() {
+      std::vector<int> last(PRODUCERS, -1);
+      std::unique_ptr<int> holder;
+      for (;;) {
+        if (q.pop(holder)) {
+          const int v = *holder;
+          ++seen[v];
+          // FIFO: a consumer sees every producer's elements in order.
+          if (v % NUM <= last[v / NUM]) {
+            ordered[c] = 0;
+          }
+          last[v / NUM] = v % NUM;
+        } else if (done_producers == PRODUCERS && q.empty()) {
+          return;
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  for (auto& n : seen) {
+    REQUIRE(n == 1);
+  }
+  for (int c = 0; c != CONSUMERS; ++c) {
+    REQUIRE(ordered[c] == 1);
+  }
+  REQUIRE(q.empty());
+}
+
+TEST_CASE("threadpool") {
+  std::pmr::synchronized_pool_resource resource;
+  {
+    yuuki::threadpool<yuuki::pmr::lockfree_queue<std::function<void()>>,
+                      std::pmr::polymorphic_allocator<std::byte>>
+        pool(&resource);
+    pool.init(4);
+    std::vector<std::future<int>> futs;
+    for (int i = 0; i != 2000; ++i) {
+      futs.push_back(pool.async([](int i) { return i * 2; }, i));
+    }
+    for (int i = 0; i != 2000; ++i) {
+      REQUIRE(futs[i].get() == i * 2);
+    }
+  }
+  yuuki::threadpool<yuuki::lockfree_queue<std::function<void()>>> pool;
+  pool.init(2);
+  std::promise<void> gate, started;
+  auto blocker = pool.async([&gate, &started]() {
+    started.set_value();
+    gate.get_future().wait();
+  });
+  started.get_future().wait();
+  // whatever is still queued is dropped, and with it its task.
+  std::vector<std::future<void>> futs;
+  for (int i = 0; i != 100; ++i) {
+    futs.push_back(pool.async([]() {}));
+  }
+  std::thread canceller([&pool]() { pool.cancel(); });
+  gate.set_value();
+  canceller.join();
+  blocker.get();
+  // every task either ran or was dropped; none is left pending.
+  int ran = 0, dropped = 0;
+  for (auto& fut : futs) {
+    REQUIRE(fut.wait_for(std::chrono::seconds(1)) == std::future_status::ready);
+    try {
+      fut.get();
+      ++ran;
+    } catch (const std::future_error& e) {
+      REQUIRE(e.code() == std::future_errc::broken_promise);
+      ++dropped;
+    }
+  }
+  REQUIRE(ran + dropped == 100);
+}
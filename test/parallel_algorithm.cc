@@ -0,0 +1,156 @@
+// =========================================================================
+// Copyright 2021 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#include <catch.h>
+#include <yuuki/parallel_algorithm.h>
+#include <yuuki/threadpool.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <future>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+std::vector<int64_t> random_input(size_t n, int64_t max) {
+  std::default_random_engine eng(42);
+  std::uniform_int_distribution<int64_t> dist(0, max);
+  std::vector<int64_t> res(n);
+  for (auto& v : res) {
+    v = dist(eng);
+  }
+  return res;
+}
+
+// around block boundaries and well beyond a single block.
+const size_t SIZES[] = {0, 1, 8191, 8192, 8193, 100000, 1000003};
+
+TEST_CASE("parallel_sort") {
+  // eight runs for the largest input, so that it takes an odd number of
+  // merge passes and ends up in the buffer.
+  yuuki::threadpool pool;
+  pool.init(8);
+  for (size_t n : SIZES) {
+    // few distinct keys, to exercise ties across runs.
+    for (int64_t max : {int64_t{7}, int64_t{1} << 40}) {
+      auto data = random_input(n, max);
+      auto expected = data;
+      std::sort(expected.begin(), expected.end());
+      yuuki::parallel_sort(pool, data.begin(), data.end());
+      REQUIRE(data == expected);
+      yuuki::parallel_sort(pool, data.begin(), data.end(), std::greater<>());
+      std::reverse(expected.begin(), expected.end());
+      REQUIRE(data == expected);
+    }
+  }
+
+  std::vector<std::string> words;
+  for (int i = 0; i != 50000; ++i) {
+    words.push_back(std::to_string(i * 7919 % 50000));
+  }
+  auto expected = words;
+  std::sort(expected.begin(), expected.end());
+  yuuki::parallel_sort(pool, words.begin(), words.end());
+  REQUIRE(words == expected);
+}
+
+TEST_CASE("parallel_inclusive_scan") {
+  yuuki::threadpool pool;
+  pool.init(4);
+  for (size_t n : SIZES) {
+    auto data = random_input(n, 1000);
+    std::vector<int64_t> expected(n);
+    std::inclusive_scan(data.begin(), data.end(), expected.begin());
+    std::vector<int64_t> out(n);
+    REQUIRE(yuuki::parallel_inclusive_scan(pool, data.begin(), data.end(),
+                                           out.begin()) == out.end());
+    REQUIRE(out == expected);
+    // in place, with another operation.
+    std::inclusive_scan(data.begin(), data.end(), expected.begin(),
+                        [](int64_t a, int64_t b) { return std::max(a, b); });
+    yuuki::parallel_inclusive_scan(
+        pool, data.begin(), data.end(), data.begin(),
+        [](int64_t a, int64_t b) { return std::max(a, b); });
+    REQUIRE(data == expected);
+  }
+}
+
+TEST_CASE("parallel_transform and parallel_copy_if") {
+  yuuki::threadpool pool;
+  pool.init(4);
+  for (size_t n : SIZES) {
+    auto data = random_input(n, 1000);
+    auto square = [](int64_t v) { return v * v; };
+    std::vector<int64_t> expected(n);
+    std::transform(data.begin(), data.end(), expected.begin(), square);
+    std::vector<int64_t> out(n);
+    REQUIRE(yuuki::parallel_transform(pool, data.begin(), data.end(),
+                                      out.begin(), square) == out.end());
+    REQUIRE(out == expected);
+
+    auto odd = [](int64_t v) { return v % 2 == 1; };
+    expected.clear();
+    std::copy_if(data.begin(), data.end(), std::back_inserter(expected), odd);
+    out.assign(n, -1);
+    auto end = yuuki::parallel_copy_if(pool, data.begin(), data.end(),
+                                       out.begin(), odd);
+    out.erase(end, out.end());
+    REQUIRE(out == expected);
+  }
+}
+
+TEST_CASE("parallel algorithms - from inside the pool") {
+  // every worker runs an algorithm whose helpers queue up behind them.
+  yuuki::threadpool pool;
+  pool.init(2);
+  std::vector<std::future<bool>> futs;
+  for (int i = 0; i != 4; ++i) {
+    futs.push_back(pool.async([&pool]() {
+      auto data = random_input(200000, 1 << 20);
+      auto expected = data;
+      std::sort(expected.begin(), expected.end());
+      yuuki::parallel_sort(pool, data.begin(), data.end());
+      return data == expected;
+    }));
+  }
+  for (auto& fut : futs) {
+    REQUIRE(fut.get());
+  }
+}
+
+TEST_CASE("parallel algorithms - exception and stopped pool") {
+  yuuki::threadpool pool;
+  pool.init(4);
+  auto data = random_input(100000, 1000);
+  std::vector<int64_t> out(data.size());
+  auto fail_at_500 = [](int64_t v) -> int64_t {
+    if (v == 500) {
+      throw std::runtime_error("500");
+    }
+    return v;
+  };
+  REQUIRE_THROWS_AS(yuuki::parallel_transform(pool, data.begin(), data.end(),
+                                              out.begin(), fail_at_500),
+                    std::runtime_error);
+
+  pool.terminate();
+  yuuki::parallel_inclusive_scan(pool, data.begin(), data.end(), out.begin());
+  REQUIRE(out.back() == std::accumulate(data.begin(), data.end(), int64_t{0}));
+}
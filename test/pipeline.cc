@@ -0,0 +1,169 @@
+// =========================================================================
+// Copyright 2021 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#include <catch.h>
+#include <yuuki/pipeline.h>
+#include <yuuki/threadpool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("pipeline - serial in order") {
+  yuuki::threadpool pool;
+  pool.init(4);
+  int next = 0;
+  std::vector<std::string> out;
+  auto p = yuuki::make_pipeline(8,
+                                [&next](yuuki::flow_control& fc) -> int {
+                                  if (next == 1000) fc.stop();
+                                  return next++;
+                                })
+               .then(yuuki::stage_mode::parallel,
+                     [](int i) -> std::string { return std::to_string(i); })
+               .then(yuuki::stage_mode::serial_in_order,
+                     [&out](std::string s) -> void { out.push_back(s); });
+  p.run(pool);
+  REQUIRE(out.size() == 1000);
+  for (int i = 0; i != 1000; ++i) {
+    REQUIRE(out[i] == std::to_string(i));
+  }
+}
+
+TEST_CASE("pipeline - serial out of order") {
+  yuuki::threadpool pool;
+  pool.init(4);
+  int next = 0;
+  int concurrent = 0;
+  bool overlapped = false;
+  std::vector<int> out;
+  auto p = yuuki::make_pipeline(8,
+                                [&next](yuuki::flow_control& fc) -> int {
+                                  if (next == 1000) fc.stop();
+                                  return next++;
+                                })
+               .then(yuuki::stage_mode::parallel,
+                     [](int i) -> int { return i * 2; })
+               .then(yuuki::stage_mode::serial_out_of_order,
+                     [&out, &concurrent, &overlapped](int i) -> void {
+                       overlapped = overlapped || ++concurrent != 1;
+                       out.push_back(i);
+                       --concurrent;
+                     });
+  p.run(pool);
+  REQUIRE_FALSE(overlapped);
+  REQUIRE(out.size() == 1000);
+  std::sort(out.begin(), out.end());
+  for (int i = 0; i != 1000; ++i) {
+    REQUIRE(out[i] == i * 2);
+  }
+}
+
+TEST_CASE("pipeline - token limit") {
+  yuuki::threadpool pool;
+  pool.init(8);
+  const int TOKENS = 3;
+  int next = 0;
+  std::atomic<int> in_flight{0};
+  std::atomic<int> peak{0};
+  auto source = [&](yuuki::flow_control& fc) -> int {
+    if (next == 200) {
+      fc.stop();
+      return 0;
+    }
+    int now = ++in_flight;
+    int old = peak.load();
+    while (now > old && !peak.compare_exchange_weak(old, now)) {
+    }
+    return next++;
+  };
+  auto p = yuuki::make_pipeline(TOKENS, source)
+               .then(yuuki::stage_mode::parallel,
+                     [](int i) -> int {
+                       std::this_thread::sleep_for(
+                           std::chrono::microseconds(100));
+                       return i;
+                     })
+               .then(yuuki::stage_mode::serial_in_order,
+                     [&in_flight](int) -> void { --in_flight; });
+  p.run(pool);
+  REQUIRE(peak.load() <= TOKENS);
+  REQUIRE(next == 200);
+}
+
+TEST_CASE("pipeline - exception and rerun") {
+  yuuki::threadpool pool;
+  pool.init(4);
+  int next = 0;
+  int sum = 0;
+  bool fail = true;
+  auto p = yuuki::make_pipeline(4,
+                                [&next](yuuki::flow_control& fc) -> int {
+                                  if (next == 100) fc.stop();
+                                  return next++;
+                                })
+               .then(yuuki::stage_mode::parallel,
+                     [&fail](int i) -> int {
+                       if (fail && i == 42) throw std::runtime_error("42");
+                       return i;
+                     })
+               .then(yuuki::stage_mode::serial_in_order,
+                     [&sum](int i) -> void { sum += i; });
+  REQUIRE_THROWS_AS(p.run(pool), std::runtime_error);
+  fail = false;
+  next = 0;
+  sum = 0;
+  p.run(pool);
+  REQUIRE(sum == 99 * 100 / 2);
+}
+
+TEST_CASE("pipeline - stopped pool") {
+  yuuki::threadpool pool;
+  pool.init(2);
+  std::thread stopper;
+  int next = 0;
+  std::atomic<int> written{0};
+  auto p = yuuki::make_pipeline(
+               4,
+               [&](yuuki::flow_control&) -> int {
+                 if (next == 10) {
+                   stopper = std::thread([&pool]() { pool.terminate(); });
+                   while (pool.is_running()) {
+                     std::this_thread::yield();
+                   }
+                 }
+                 return next++;
+               })
+               .then(yuuki::stage_mode::parallel,
+                     [](int v) -> int {
+                       std::this_thread::sleep_for(
+                           std::chrono::microseconds(v % 3 * 100));
+                       return v;
+                     })
+               .then(yuuki::stage_mode::serial_in_order,
+                     [&written](int) { ++written; });
+  // the source is refused once the pool stops; the run must still end.
+  REQUIRE_THROWS_AS(p.run(pool), std::runtime_error);
+  stopper.join();
+  REQUIRE(written <= 11);
+  REQUIRE_THROWS_AS(p.run(pool), std::runtime_error);
+}
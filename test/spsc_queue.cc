@@ -0,0 +1,179 @@
+// =========================================================================
+// Copyright 2021 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#include <catch.h>
+#include <yuuki/spsc_queue.h>
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+TEST_CASE("single-thread usage") {
+  yuuki::spsc_queue<uint64_t> q(42);
+  REQUIRE(q.capacity() == 64);
+  REQUIRE(q.empty());
+  REQUIRE(q.push(42UL));
+  REQUIRE_FALSE(q.empty());
+  q.clear();
+  REQUIRE(q.empty());
+  for (uint64_t i = 0; i != 64UL; ++i) {
+    REQUIRE(q.emplace(i));
+  }
+  REQUIRE_FALSE(q.push(64UL));
+  REQUIRE(q.size() == 64);
+  for (uint64_t i = 0; i != 64UL; ++i) {
+    uint64_t holder;
+    REQUIRE(q.pop(holder));
+    REQUIRE(holder == i);
+  }
+  uint64_t holder;
+  REQUIRE_FALSE(q.pop(holder));
+}
+
+TEST_CASE("batch push-pop with wrap-around") {
+  yuuki::spsc_queue<uint64_t> q(8);
+  std::vector<uint64_t> in{0, 1, 2, 3, 4, 5};
+  std::vector<uint64_t> out(8);
+  REQUIRE(q.push_n(in.begin(), in.size()) == 6);
+  REQUIRE(q.pop_n(out.begin(), 4) == 4);
+  REQUIRE(q.push_n(in.begin(), in.size()) == 6);
+  REQUIRE(q.size() == 8);
+  REQUIRE(q.pop_n(out.begin(), out.size()) == 8);
+  std::vector<uint64_t> expected{4, 5, 0, 1, 2, 3, 4, 5};
+  REQUIRE(out == expected);
+  REQUIRE(q.pop_n(out.begin(), out.size()) == 0);
+}
+
+TEST_CASE("non-trivial elements") {
+  yuuki::spsc_queue<std::shared_ptr<int>> q(4);
+  auto p = std::make_shared<int>(42);
+  REQUIRE(q.push(p));
+  REQUIRE(q.push(p));
+  REQUIRE(p.use_count() == 3);
+  std::shared_ptr<int> holder;
+  REQUIRE(q.pop(holder));
+  REQUIRE(*holder == 42);
+  holder.reset();
+  REQUIRE(p.use_count() == 2);
+  q.clear();
+  REQUIRE(p.use_count() == 1);
+}
+
+// its copy constructor throws once `budget` copies have been made.
+struct fragile {
+  static int budget;
+  static int alive;
+  fragile() {
+    ++alive;
+  }
+  fragile(const fragile&) {
+    if (budget-- == 0) {
+      throw std::runtime_error("copy");
+    }
+    ++alive;
+  }
+  ~fragile() {
+    --alive;
+  }
+};
+int fragile::budget = 0;
+int fragile::alive = 0;
+
+TEST_CASE("failed batches and oversized rings") {
+  {
+    std::vector<fragile> in(4);
+    yuuki::spsc_queue<fragile> q(8);
+    fragile::budget = 2;
+    REQUIRE_THROWS_AS(q.push_n(in.begin(), in.size()), std::runtime_error);
+    // the two copies made were destroyed, and none was published.
+    REQUIRE(fragile::alive == 4);
+    REQUIRE(q.empty());
+    fragile::budget = 4;
+    REQUIRE(q.push_n(in.begin(), in.size()) == 4);
+    REQUIRE(fragile::alive == 8);
+  }
+  REQUIRE(fragile::alive == 0);
+  REQUIRE_THROWS_AS(
+      yuuki::spsc_queue<char>(std::numeric_limits<size_t>::max()),
+      std::length_error);
+}
+
+TEST_CASE("two-thread ordering") {
+  const uint64_t NUM = 1 << 20;
+  yuuki::spsc_queue<uint64_t> q(1024);
+  std::thread producer([&q, NUM]() {
+    for (uint64_t i = 0; i != NUM; ++i) {
+      while (!q.push(i)) std::this_thread::yield();
+    }
+  });
+  bool in_order = true;
+  for (uint64_t i = 0; i != NUM; ++i) {
+    uint64_t holder;
+    while (!q.pop(holder)) std::this_thread::yield();
+    in_order = in_order && holder == i;
+  }
+  producer.join();
+  REQUIRE(in_order);
+  REQUIRE(q.empty());
+}
+
+TEST_CASE("channel - blocking ordering and close") {
+  const uint64_t NUM = 1 << 16;
+  yuuki::spsc_channel<uint64_t> ch(16);
+  std::thread producer([&ch, NUM]() {
+    for (uint64_t i = 0; i != NUM; ++i) {
+      ch.push(i);
+    }
+    ch.close();
+  });
+  uint64_t expected = 0;
+  uint64_t holder;
+  bool in_order = true;
+  while (ch.pop(holder)) {
+    in_order = in_order && holder == expected;
+    ++expected;
+  }
+  producer.join();
+  REQUIRE(in_order);
+  REQUIRE(expected == NUM);
+  REQUIRE(ch.closed());
+  REQUIRE_FALSE(ch.push(0));
+  REQUIRE_FALSE(ch.try_push(0));
+}
+
+TEST_CASE("channel - close wakes a parked producer") {
+  yuuki::spsc_channel<int> ch(2);
+  REQUIRE(ch.try_push(0));
+  REQUIRE(ch.try_push(1));
+  REQUIRE_FALSE(ch.try_push(2));
+  bool pushed = true;
+  std::thread producer([&ch, &pushed]() { pushed = ch.push(2); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ch.close();
+  producer.join();
+  REQUIRE_FALSE(pushed);
+  int holder;
+  REQUIRE(ch.pop(holder));
+  REQUIRE(holder == 0);
+  REQUIRE(ch.pop(holder));
+  REQUIRE(holder == 1);
+  REQUIRE_FALSE(ch.pop(holder));
+}
@@ -0,0 +1,135 @@
+// =========================================================================
+// Copyright 2021 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#include <catch.h>
+#include <yuuki/task_graph.h>
+#include <yuuki/threadpool.h>
+
+#include <atomic>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+TEST_CASE("task_graph - diamond") {
+  yuuki::threadpool pool;
+  pool.init(4);
+  std::atomic<int> clock{0};
+  std::vector<int> at(4, -1);
+  yuuki::task_graph g;
+  std::vector<yuuki::task_graph::node> n;
+  for (int i = 0; i != 4; ++i) {
+    n.push_back(g.emplace([&clock, &at, i]() { at[i] = clock++; }));
+  }
+  g.precede(n[0], n[1]);
+  g.precede(n[0], n[2]);
+  g.precede(n[1], n[3]);
+  g.precede(n[2], n[3]);
+  g.run(pool);
+  REQUIRE(at[0] == 0);
+  REQUIRE(at[3] == 3);
+  REQUIRE(clock == 4);
+}
+
+TEST_CASE("task_graph - random dag, repeated runs") {
+  const int NUM = 2000;
+  yuuki::threadpool pool;
+  pool.init(4);
+  std::default_random_engine eng(42);
+  std::atomic<int> clock{0};
+  std::vector<int> at(NUM, -1);
+  std::vector<std::pair<int, int>> edges;
+  yuuki::task_graph g;
+  for (int i = 0; i != NUM; ++i) {
+    g.emplace([&clock, &at, i]() { at[i] = clock++; });
+    for (int k = 0; i != 0 && k != 3; ++k) {
+      int pred = std::uniform_int_distribution<int>(0, i - 1)(eng);
+      g.precede(pred, i);
+      edges.emplace_back(pred, i);
+    }
+  }
+  REQUIRE(g.size() == NUM);
+  for (int round = 0; round != 3; ++round) {
+    clock = 0;
+    g.run(pool);
+    REQUIRE(clock == NUM);
+    bool ordered = true;
+    for (auto& e : edges) {
+      ordered = ordered && at[e.first] < at[e.second];
+    }
+    REQUIRE(ordered);
+  }
+}
+
+TEST_CASE("task_graph - cycle and bad node") {
+  yuuki::threadpool pool;
+  pool.init(2);
+  yuuki::task_graph g;
+  auto a = g.emplace([]() {});
+  auto b = g.emplace([]() {});
+  REQUIRE_THROWS_AS(g.precede(a, 42), std::out_of_range);
+  g.precede(a, b);
+  g.precede(b, a);
+  REQUIRE_THROWS_AS(g.run(pool), std::invalid_argument);
+}
+
+TEST_CASE("task_graph - exception skips the rest") {
+  yuuki::threadpool pool;
+  pool.init(2);
+  yuuki::task_graph g;
+  bool ran = false;
+  auto a = g.emplace([]() { throw std::runtime_error("a"); });
+  auto b = g.emplace([&ran]() { ran = true; });
+  g.precede(a, b);
+  REQUIRE_THROWS_AS(g.run(pool), std::runtime_error);
+  REQUIRE_FALSE(ran);
+}
+
+TEST_CASE("task_graph - stopped pool") {
+  yuuki::threadpool pool;
+  pool.init(2);
+  yuuki::task_graph g;
+  std::atomic<int> ran{0};
+  std::thread stopper;
+  auto a = g.emplace([&pool, &stopper, &ran]() {
+    ++ran;
+    stopper = std::thread([&pool]() { pool.terminate(); });
+    while (pool.is_running()) {
+      std::this_thread::yield();
+    }
+  });
+  for (int i = 0; i != 3; ++i) {
+    g.precede(a, g.emplace([&ran]() { ++ran; }));
+  }
+  // the successors of `a` are refused by the stopping pool.
+  REQUIRE_THROWS_AS(g.run(pool), std::runtime_error);
+  stopper.join();
+  REQUIRE(ran == 1);
+  // nothing is scheduled at all.
+  REQUIRE_THROWS_AS(g.run(pool), std::runtime_error);
+  REQUIRE(ran == 1);
+}
+
+TEST_CASE("task_graph - empty") {
+  yuuki::threadpool pool;
+  pool.init(1);
+  yuuki::task_graph g;
+  g.run(pool);
+  REQUIRE(g.size() == 0);
+}
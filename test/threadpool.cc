@@ -18,9 +18,11 @@
 #include <catch.h>
 #include <yuuki/threadpool.h>
 
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <future>
+#include <memory_resource>
 #include <random>
 
 TEST_CASE("threadpool - dryrun") {
@@ -191,3 +193,137 @@ TEST_CASE("threadpool - cancel before async") {
   }
   std::cerr << "Cancelled int: " << cancelled_int << std::endl;
 }
+
+// counts what reaches the upstream, i.e. what the pool did not serve itself.
+class counting_resource : public std::pmr::memory_resource {
+ public:
+  std::atomic<size_t> allocations{0};
+
+ private:
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    ++allocations;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+  bool do_is_equal(const std::pmr::memory_resource& other) const
+      noexcept override {
+    return this == &other;
+  }
+};
+
+TEST_CASE("threadpool - memory resource") {
+  counting_resource upstream;
+  std::pmr::synchronized_pool_resource resource(&upstream);
+  {
+    yuuki::pmr::threadpool<> pool(&resource);
+    REQUIRE(pool.get_allocator().resource() == &resource);
+    pool.init(3);
+    std::vector<std::future<int>> int_futs;
+    for (int i = 0; i != 30; ++i) {
+      int_futs.emplace_back(pool.async([](int i) -> int { return i; }, i));
+    }
+    for (int i = 0; i != 30; ++i) {
+      REQUIRE(int_futs[i].get() == i);
+    }
+  }
+  REQUIRE(upstream.allocations > 0);
+
+  // used directly, the resource sees every allocation: besides the queue node,
+  // each task wrapper and the shared state of its future.
+  counting_resource direct;
+  {
+    yuuki::pmr::threadpool<> pool(&direct);
+    pool.init(1);
+    pool.async([]() {}).get();
+    const size_t before = direct.allocations;
+    for (int i = 0; i != 30; ++i) {
+      REQUIRE(pool.async([](int i) -> int { return i; }, i).get() == i);
+    }
+    REQUIRE(direct.allocations - before >= 3 * 30);
+  }
+}
+
+TEST_CASE("threadpool - blocking scope") {
+  yuuki::threadpool<> pool;
+  pool.init(1, 2);
+  REQUIRE(pool.spares() == 0);
+  // the only worker waits for a task queued behind itself: without a spare
+  // this never finishes.
+  auto outer = pool.async([&pool]() -> int {
+    auto inner = pool.async([]() -> int { return 42; });
+    return pool.run_blocking([&inner]() { return inner.get(); });
+  });
+  REQUIRE(outer.get() == 42);
+  REQUIRE(pool.spares() == 1);
+
+  // the spare is parked and reused, not started again.
+  auto again = pool.async([&pool]() -> int {
+    auto inner = pool.async([]() -> int { return 7; });
+    yuuki::blocking_scope scope;
+    yuuki::blocking_scope nested;
+    return inner.get();
+  });
+  REQUIRE(again.get() == 7);
+  REQUIRE(pool.spares() == 1);
+
+  // outside of a worker, the scope does nothing.
+  {
+    yuuki::blocking_scope scope;
+  }
+  REQUIRE(pool.spares() == 1);
+}
+
+TEST_CASE("threadpool - terminate while blocked on a queued task") {
+  // `terminate()` comes before or after the worker blocks, with `inner` still
+  // queued either way; a spare must run it for the worker.
+  for (int round = 0; round != 200; ++round) {
+    yuuki::threadpool<> pool;
+    pool.init(1);
+    std::promise<void> queued;
+    auto outer = pool.async([&pool, &queued, round]() -> int {
+      auto inner = pool.async([]() -> int { return 42; });
+      if (round % 2 == 0) {
+        queued.set_value();
+      }
+      return pool.run_blocking([&inner, &queued, round]() {
+        if (round % 2 != 0) {
+          queued.set_value();
+        }
+        return inner.get();
+      });
+    });
+    queued.get_future().wait();
+    pool.terminate();
+    REQUIRE(outer.get() == 42);
+  }
+}
+
+TEST_CASE("threadpool - spares are capped") {
+  yuuki::threadpool<> pool;
+  pool.init(2, 1);
+  std::promise<void> gate;
+  std::shared_future<void> opened = gate.get_future().share();
+  std::atomic<int> ran{0};
+  std::vector<std::future<void>> blockers;
+  for (int i = 0; i != 2; ++i) {
+    blockers.push_back(pool.async([&pool, opened]() {
+      pool.run_blocking([&opened]() { opened.wait(); });
+    }));
+  }
+  std::vector<std::future<void>> futs;
+  for (int i = 0; i != 10; ++i) {
+    futs.push_back(pool.async([&ran]() { ++ran; }));
+  }
+  // two workers blocked, but only one spare to stand in for them.
+  for (auto& fut : futs) {
+    fut.get();
+  }
+  REQUIRE(ran == 10);
+  REQUIRE(pool.spares() == 1);
+  gate.set_value();
+  for (auto& fut : blockers) {
+    fut.get();
+  }
+}
@@ -20,6 +20,8 @@
 
 #include <cstdint>
 #include <future>
+#include <memory_resource>
+#include <stdexcept>
 #include <vector>
 
 TEST_CASE("single-thread usage") {
@@ -86,3 +88,71 @@ TEST_CASE("multiple-thread push-pop") {
     REQUIRE(fut.get());
   }
 }
+
+TEST_CASE("memory resource") {
+  std::pmr::monotonic_buffer_resource upstream;
+  std::pmr::unsynchronized_pool_resource pool(&upstream);
+  yuuki::pmr::threadsafe_queue<uint64_t> q(&pool);
+  REQUIRE(q.get_allocator().resource() == &pool);
+  for (uint64_t i = 0; i != 42UL; ++i) {
+    q.push(i);
+  }
+  REQUIRE(q.size() == 42);
+  for (uint64_t i = 0; i != 42UL; ++i) {
+    uint64_t holder;
+    REQUIRE(q.pop(holder));
+    REQUIRE(holder == i);
+  }
+  REQUIRE(q.empty());
+}
+
+// throws from its move assignment when asked to.
+struct fragile {
+  bool throws{false};
+  fragile() = default;
+  explicit fragile(bool t) : throws(t) {
+  }
+  fragile(fragile&&) = default;
+  fragile& operator=(fragile&& other) {
+    if (other.throws) {
+      throw std::runtime_error("fragile");
+    }
+    throws = other.throws;
+    return *this;
+  }
+};
+
+// counts the bytes allocated and not yet released.
+class balance_resource : public std::pmr::memory_resource {
+ public:
+  size_t outstanding{0};
+
+ private:
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    outstanding += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+    outstanding -= bytes;
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept
+      override {
+    return this == &other;
+  }
+};
+
+TEST_CASE("throwing element") {
+  balance_resource resource;
+  {
+    yuuki::pmr::threadsafe_queue<fragile> q(&resource);
+    const size_t empty = resource.outstanding;
+    REQUIRE_THROWS_AS(q.push(fragile(true)), std::runtime_error);
+    REQUIRE_THROWS_AS(q.emplace(true), std::runtime_error);
+    REQUIRE(resource.outstanding == empty);
+    REQUIRE(q.empty());
+    q.push(fragile(false));
+    REQUIRE(q.size() == 1);
+  }
+  REQUIRE(resource.outstanding == 0);
+}
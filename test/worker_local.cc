@@ -0,0 +1,189 @@
+// =========================================================================
+// Copyright 2021 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#include <catch.h>
+#include <yuuki/scratch_arena.h>
+#include <yuuki/threadpool.h>
+#include <yuuki/worker_local.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory_resource>
+#include <set>
+#include <vector>
+
+// counts what the arena takes from upstream.
+class counting_resource : public std::pmr::memory_resource {
+ public:
+  int allocations{0};
+  int live{0};
+
+ private:
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    ++allocations;
+    ++live;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+    --live;
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+  bool do_is_equal(const std::pmr::memory_resource& other) const
+      noexcept override {
+    return this == &other;
+  }
+};
+
+TEST_CASE("scratch_arena") {
+  counting_resource upstream;
+  {
+    yuuki::scratch_arena arena(1024, &upstream);
+    void* a = arena.allocate(100, 8);
+    void* b = arena.allocate(10, 64);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(b) % 64 == 0);
+    REQUIRE(b > a);
+    REQUIRE(upstream.allocations == 1);
+
+    auto m = arena.mark();
+    void* c = arena.allocate(100, 8);
+    arena.rewind(m);
+    REQUIRE(arena.allocate(100, 8) == c);
+
+    // outgrows the first chunk: the reset merges both into one, after which
+    // the same work takes nothing more from upstream.
+    REQUIRE(arena.allocate(4000, 8) != nullptr);
+    REQUIRE(upstream.allocations == 2);
+    arena.reset();
+    REQUIRE(upstream.allocations == 3);
+    REQUIRE(upstream.live == 1);
+    for (int round = 0; round != 10; ++round) {
+      REQUIRE(arena.allocate(100, 8) != nullptr);
+      REQUIRE(arena.allocate(4000, 8) != nullptr);
+      arena.reset();
+    }
+    REQUIRE(upstream.allocations == 3);
+
+    std::pmr::vector<int> v(&arena);
+    for (int i = 0; i != 1000; ++i) {
+      v.push_back(i);
+    }
+    REQUIRE(v[999] == 999);
+  }
+  REQUIRE(upstream.live == 0);
+}
+
+TEST_CASE("worker_scratch - reset after every task") {
+  yuuki::threadpool<> pool;
+  pool.init(1);
+  // the arena is handed back after each task, so every task starts at the
+  // same address.
+  std::set<void*> firsts;
+  for (int i = 0; i != 20; ++i) {
+    firsts.insert(pool.async([]() {
+                        std::pmr::vector<char> buf(1000, 'x',
+                                                   yuuki::worker_scratch());
+                        return static_cast<void*>(buf.data());
+                      })
+                      .get());
+  }
+  REQUIRE(firsts.size() == 1);
+
+  // a scope hands back what a batch item used.
+  REQUIRE(pool.async([]() {
+                auto* arena = yuuki::worker_scratch();
+                void* first = nullptr;
+                bool same = true;
+                for (int i = 0; i != 10; ++i) {
+                  yuuki::scratch_scope scope;
+                  void* p = arena->allocate(256);
+                  if (first == nullptr) {
+                    first = p;
+                  }
+                  same = same && p == first;
+                }
+                return same;
+              })
+              .get());
+
+  // outside pools: the default resource.
+  REQUIRE(yuuki::worker_scratch() == std::pmr::get_default_resource());
+}
+
+TEST_CASE("worker_local - combine") {
+  yuuki::threadpool<> pool;
+  pool.init(4);
+  std::atomic<int> constructed{0};
+  yuuki::worker_local<int64_t> sums(pool, [&constructed]() -> int64_t {
+    ++constructed;
+    return 0;
+  });
+  std::vector<std::future<void>> futs;
+  for (int i = 1; i <= 1000; ++i) {
+    futs.push_back(pool.async([&sums, i]() { sums.local() += i; }));
+  }
+  for (auto& fut : futs) {
+    fut.get();
+  }
+  // one per worker that ran a task, plus ours.
+  sums.local() += 1;
+  REQUIRE(constructed >= 2);
+  REQUIRE(constructed <= 5);
+  REQUIRE(sums.combine() == 500500 + 1);
+
+  int visited = 0;
+  sums.for_each([&visited](int64_t&) { ++visited; });
+  REQUIRE(visited == constructed);
+
+  sums.clear();
+  REQUIRE(sums.combine() == 0);
+  REQUIRE(pool.async([&sums]() { return sums.local(); }).get() == 0);
+}
+
+TEST_CASE("worker_local - spares and other pools") {
+  yuuki::threadpool<> pool;
+  pool.init(1, 1);
+  REQUIRE(pool.max_threads() == 2);
+  yuuki::worker_local<std::vector<int>> seen(pool);
+
+  // the worker blocks, so the queued task runs on the spare: a second
+  // instance.
+  std::promise<void> gate;
+  auto opened = gate.get_future().share();
+  auto blocker = pool.async([&pool, &seen, opened]() {
+    seen.local().push_back(1);
+    pool.run_blocking([&opened]() { opened.wait(); });
+  });
+  auto other = pool.async([&seen]() { seen.local().push_back(2); });
+  other.get();
+  gate.set_value();
+  blocker.get();
+
+  // a worker of another pool counts as an outsider.
+  yuuki::threadpool<> foreign;
+  foreign.init(1);
+  foreign.async([&seen]() { seen.local().push_back(3); }).get();
+
+  std::vector<int> all;
+  seen.for_each([&all](std::vector<int>& v) {
+    all.insert(all.end(), v.begin(), v.end());
+    REQUIRE(v.size() == 1);
+  });
+  std::sort(all.begin(), all.end());
+  REQUIRE(all == std::vector<int>{1, 2, 3});
+}
@@ -17,18 +17,29 @@
 
 #pragma once
 
+#include <deque>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <queue>
 #include <shared_mutex>
 
 namespace yuuki {
-template <typename T>
-class blocking_queue : protected std::queue<T> {
+template <typename T, typename Allocator = std::allocator<T>>
+class blocking_queue : protected std::queue<T, std::deque<T, Allocator>> {
+ private:
+  using base = std::queue<T, std::deque<T, Allocator>>;
+
  public:
   using wlock = std::unique_lock<std::shared_mutex>;
   using rlock = std::shared_lock<std::shared_mutex>;
+  using value_type = T;
+  using allocator_type = Allocator;
 
  public:
   blocking_queue() = default;
+  explicit blocking_queue(const Allocator& alloc) : base(alloc) {
+  }
   ~blocking_queue() {
     clear();
   }
@@ -40,45 +51,56 @@ class blocking_queue : protected std::queue<T> {
  public:
   bool empty() const {
     rlock lock(mtx_);
-    return std::queue<T>::empty();
+    return base::empty();
   }
 
   size_t size() const {
     rlock lock(mtx_);
-    return std::queue<T>::size();
+    return base::size();
   }
 
  public:
   void clear() {
     wlock lock(mtx_);
-    while (!std::queue<T>::empty()) {
-      std::queue<T>::pop();
+    while (!base::empty()) {
+      base::pop();
     }
   }
 
   void push(const T& obj) {
     wlock lock(mtx_);
-    std::queue<T>::push(obj);
+    base::push(obj);
   }
 
   template <typename... Args>
   void emplace(Args&&... args) {
     wlock lock(mtx_);
-    std::queue<T>::emplace(std::forward<Args>(args)...);
+    base::emplace(std::forward<Args>(args)...);
   }
 
   bool pop(T& holder) {
     wlock lock(mtx_);
-    if (std::queue<T>::empty()) {
+    if (base::empty()) {
       return false;
     } else {
-      holder = std::move(std::queue<T>::front());
-      std::queue<T>::pop();
+      holder = std::move(base::front());
+      base::pop();
       return true;
     }
   }
 
+ public:
+  allocator_type get_allocator() const {
+    return base::c.get_allocator();
+  }
+
  private:
   mutable std::shared_mutex mtx_;
 };
+
+namespace pmr {
+template <typename T>
+using blocking_queue =
+    yuuki::blocking_queue<T, std::pmr::polymorphic_allocator<T>>;
+}  // namespace pmr
 }  // namespace yuuki
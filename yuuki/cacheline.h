@@ -0,0 +1,26 @@
+// =========================================================================
+// Copyright 2022 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#pragma once
+
+#include <cstddef>
+
+namespace yuuki {
+// `std::hardware_destructive_interference_size` is not reliably available
+// (and triggers -Winterference-size on GCC), so pin it to the common value.
+inline constexpr std::size_t cacheline_size = 64;
+}  // namespace yuuki
@@ -0,0 +1,301 @@
+// =========================================================================
+// Copyright 2022 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#pragma once
+
+#include <yuuki/cacheline.h>
+#include <yuuki/threadpool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace yuuki {
+using deadline_clock = std::chrono::steady_clock;
+
+// Element of a `deadline_queue`. Tasks delegated through plain `async()` get
+// no deadline and are therefore served after every task that has one.
+class deadline_task {
+ public:
+  deadline_task() = default;
+  template <typename F, typename = std::enable_if_t<
+                            !std::is_same_v<std::decay_t<F>, deadline_task>>>
+  deadline_task(F&& f)  // NOLINT(runtime/explicit)
+      : fn_(std::forward<F>(f)) {
+  }
+  template <typename F>
+  deadline_task(deadline_clock::time_point deadline, F&& f)
+      : deadline_(deadline), fn_(std::forward<F>(f)) {
+  }
+
+ public:
+  deadline_clock::time_point deadline() const {
+    return deadline_;
+  }
+
+  void operator()() {
+    fn_();
+  }
+
+ private:
+  deadline_clock::time_point deadline_{deadline_clock::time_point::max()};
+  std::function<void()> fn_;
+};
+
+// Earliest-deadline-first queue, sharded to keep contention low.
+//
+// Every push draws a ticket from a shared counter and goes to the shard the
+// ticket picks, round-robin, so even a single dispatcher thread spreads its
+// tasks over all shards. Each shard is a small binary heap under its own lock
+// and publishes the deadline and ticket of its top in atomics, so a consumer
+// picks the most urgent shard without taking any lock and then locks only
+// that one. Without concurrent consumers the order is exact, equal deadlines
+// being served in submission order; otherwise a consumer may lose a race for
+// a top and serve the next-best one.
+template <typename T = deadline_task, typename Allocator = std::allocator<T>>
+class deadline_queue {
+ public:
+  using wlock = std::unique_lock<std::shared_mutex>;
+  using rlock = std::shared_lock<std::shared_mutex>;
+  using value_type = T;
+  using allocator_type = Allocator;
+
+ private:
+  using rep = deadline_clock::rep;
+  static constexpr rep kEmpty = std::numeric_limits<rep>::max();
+
+  struct entry {
+    rep deadline;
+    uint64_t seq;
+    T value;
+  };
+  // `std::push_heap` builds a max-heap: "greater" puts the earliest on top.
+  struct later {
+    bool operator()(const entry& a, const entry& b) const {
+      return a.deadline != b.deadline ? a.deadline > b.deadline : a.seq > b.seq;
+    }
+  };
+  using entry_allocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<entry>;
+
+  struct alignas(cacheline_size) shard {
+    explicit shard(const Allocator& alloc) : heap(entry_allocator(alloc)) {
+    }
+    std::atomic<rep> top{kEmpty};
+    std::atomic<uint64_t> top_seq{0};  // breaks ties between shards
+    mutable std::shared_mutex mtx;
+    std::vector<entry, entry_allocator> heap;
+
+    void publish() {
+      if (!heap.empty()) {
+        top_seq.store(heap.front().seq, std::memory_order_relaxed);
+      }
+      top.store(heap.empty() ? kEmpty : heap.front().deadline,
+                std::memory_order_release);
+    }
+  };
+
+ public:
+  deadline_queue() : deadline_queue(Allocator()) {
+  }
+  explicit deadline_queue(const Allocator& alloc,
+                          size_t shards = std::thread::hardware_concurrency())
+      : alloc_(alloc) {
+    shards = std::max<size_t>(shards, 1);
+    shards_.reserve(shards);
+    for (size_t i = 0; i != shards; ++i) {
+      shards_.emplace_back(std::make_unique<shard>(alloc));
+    }
+  }
+  ~deadline_queue() = default;
+  deadline_queue(const deadline_queue&) = delete;
+  deadline_queue(deadline_queue&&) = delete;
+  deadline_queue& operator=(const deadline_queue&) = delete;
+  deadline_queue& operator=(deadline_queue&&) = delete;
+
+ public:
+  allocator_type get_allocator() const {
+    return alloc_;
+  }
+
+  bool empty() const {
+    for (auto& s : shards_) {
+      if (s->top.load(std::memory_order_acquire) != kEmpty) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  size_t size() const {
+    size_t res = 0;
+    for (auto& s : shards_) {
+      rlock lock(s->mtx);
+      res += s->heap.size();
+    }
+    return res;
+  }
+
+ public:
+  void clear() {
+    for (auto& s : shards_) {
+      wlock lock(s->mtx);
+      s->heap.clear();
+      s->publish();
+    }
+  }
+
+  void push(T obj) {
+    // `kEmpty` is reserved to mark an empty shard.
+    const rep deadline =
+        std::min(obj.deadline().time_since_epoch().count(), kEmpty - 1);
+    const uint64_t seq = seq_.fetch_add(1, std::memory_order_relaxed);
+    shard& s = *shards_[seq % shards_.size()];
+    wlock lock(s.mtx);
+    s.heap.push_back(entry{deadline, seq, std::move(obj)});
+    std::push_heap(s.heap.begin(), s.heap.end(), later());
+    s.publish();
+  }
+
+  template <typename... Args>
+  void emplace(Args&&... args) {
+    push(T(std::forward<Args>(args)...));
+  }
+
+  bool pop(T& holder) {
+    // a shard that looked best may be drained by someone else meanwhile;
+    // give up only once a full scan has seen every shard empty.
+    for (;;) {
+      shard* best = nullptr;
+      rep best_deadline = kEmpty;
+      uint64_t best_seq = 0;
+      for (auto& s : shards_) {
+        const rep top = s->top.load(std::memory_order_acquire);
+        if (top == kEmpty || top > best_deadline) {
+          continue;
+        }
+        const uint64_t seq = s->top_seq.load(std::memory_order_relaxed);
+        if (top < best_deadline || seq < best_seq) {
+          best = s.get();
+          best_deadline = top;
+          best_seq = seq;
+        }
+      }
+      if (best == nullptr) {
+        return false;
+      }
+      wlock lock(best->mtx);
+      if (best->heap.empty()) {
+        continue;
+      }
+      std::pop_heap(best->heap.begin(), best->heap.end(), later());
+      holder = std::move(best->heap.back().value);
+      best->heap.pop_back();
+      best->publish();
+      return true;
+    }
+  }
+
+ private:
+  const Allocator alloc_;
+  std::vector<std::unique_ptr<shard>> shards_;
+  alignas(cacheline_size) std::atomic<uint64_t> seq_{0};
+};
+
+// tag for `async_with_deadline`: if a task is only picked up after its
+// deadline, do not run it; its future fails with `std::errc::timed_out`.
+struct skip_expired_t {
+  explicit skip_expired_t() = default;
+};
+inline constexpr skip_expired_t skip_expired{};
+
+namespace detail {
+template <typename Queue>
+struct is_deadline_queue : std::false_type {};
+template <typename T, typename Allocator>
+struct is_deadline_queue<deadline_queue<T, Allocator>> : std::true_type {};
+
+template <bool skip, typename Pool, class F, class... Args>
+auto async_with_deadline(const Pool& pool, deadline_clock::time_point deadline,
+                         F&& f, Args&&... args)
+    -> std::future<decltype(f(args...))> {
+  static_assert(is_deadline_queue<typename Pool::queue_type>::value,
+                "async_with_deadline needs a pool running on a deadline_queue, "
+                "e.g. deadline_threadpool");
+  using return_t = decltype(f(args...));
+  // refuse before allocating; `post()` checks again.
+  pool.check_accepting();
+  auto bind_func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+  using task_t = detail::pool_task<return_t, decltype(bind_func)>;
+  auto alloc = pool.get_allocator();
+  std::shared_ptr<task_t> task =
+      std::allocate_shared<task_t>(alloc, alloc, std::move(bind_func));
+  std::future<return_t> fut = task->get_future();
+  pool.post(deadline, [task, deadline]() -> void {
+    if (skip && deadline_clock::now() > deadline) {
+      task->fail(std::make_exception_ptr(
+          std::system_error(std::make_error_code(std::errc::timed_out),
+                            "Task picked up after its deadline")));
+    } else {
+      (*task)();
+    }
+  });
+  return fut;
+}
+}  // namespace detail
+
+// Delegates `f(args...)` to `pool` with `deadline`. The pool must run on a
+// `deadline_queue` (see `deadline_threadpool`); other pools are rejected at
+// compile time.
+template <typename Pool, class F, class... Args>
+auto async_with_deadline(const Pool& pool, deadline_clock::time_point deadline,
+                         F&& f, Args&&... args)
+    -> std::future<decltype(f(args...))> {
+  return detail::async_with_deadline<false>(
+      pool, deadline, std::forward<F>(f), std::forward<Args>(args)...);
+}
+
+template <typename Pool, class F, class... Args>
+auto async_with_deadline(const Pool& pool, deadline_clock::time_point deadline,
+                         skip_expired_t, F&& f, Args&&... args)
+    -> std::future<decltype(f(args...))> {
+  return detail::async_with_deadline<true>(
+      pool, deadline, std::forward<F>(f), std::forward<Args>(args)...);
+}
+
+using deadline_threadpool = threadpool<deadline_queue<>>;
+
+namespace pmr {
+template <typename T = deadline_task>
+using deadline_queue =
+    yuuki::deadline_queue<T, std::pmr::polymorphic_allocator<T>>;
+}  // namespace pmr
+}  // namespace yuuki
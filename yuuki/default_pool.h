@@ -0,0 +1,216 @@
+// =========================================================================
+// Copyright 2022 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#pragma once
+
+#include <yuuki/threadpool.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace yuuki {
+// The number of CPUs this process may actually use: `hardware_concurrency()`,
+// narrowed by the CPU affinity mask and by a cgroup CPU quota (v2 `cpu.max`
+// or v1 `cpu.cfs_quota_us`), as containers set them. At least 1.
+inline int default_concurrency() {
+  int n = static_cast<int>(std::thread::hardware_concurrency());
+  if (n <= 0) {
+    n = 1;
+  }
+#if defined(__linux__)
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    n = std::min(n, std::max(CPU_COUNT(&set), 1));
+  }
+  double quota = -1, period = 0;
+  std::ifstream v2("/sys/fs/cgroup/cpu.max");
+  std::string max;
+  if (v2 >> max >> period) {
+    if (max != "max") {
+      try {
+        quota = std::stod(max);
+      } catch (const std::exception&) {  // malformed: no quota then
+        quota = -1;
+      }
+    }
+  } else {
+    std::ifstream q("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+    std::ifstream p("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+    if (!(q >> quota && p >> period)) {
+      quota = -1;
+    }
+  }
+  if (quota > 0 && period > 0) {
+    const double cpus = quota / period;
+    const int whole = static_cast<int>(cpus);
+    n = std::min(n, std::max(whole + (cpus > whole ? 1 : 0), 1));
+  }
+#endif
+  return n;
+}
+
+// The process-wide pool, meant to be shared by components instead of each
+// running its own: `default_concurrency()` workers, started lazily as load
+// arrives, so that merely linking components in costs no threads. Components
+// that need a bound on their share use an `executor` over it. Lives until
+// static destruction; do not use it from destructors of other statics.
+inline threadpool<>& default_pool() {
+  static threadpool<>& pool = []() -> threadpool<>& {
+    static threadpool<> p;
+    p.init_lazily(default_concurrency());
+    return p;
+  }();
+  return pool;
+}
+
+// A view of a pool that runs at most `max_concurrency` of its tasks at once;
+// cheap to copy, copies share the limit. Tasks over the limit wait in the
+// view, not in the pool, and are handed to the pool as earlier ones finish,
+// so views with small limits never hog the shared workers. An unlimited view
+// adds nothing to a plain `async()`. If the pool stops while tasks wait in
+// the view, those are dropped and their futures report a broken promise.
+template <typename Pool>
+class executor {
+ private:
+  struct state {
+    explicit state(int cap) : max_concurrency(cap) {
+    }
+    const int max_concurrency;
+    std::mutex mtx;
+    int running{0};                              // guarded by `mtx`
+    std::deque<std::function<void()>> pending;  // guarded by `mtx`
+  };
+
+ public:
+  explicit executor(const Pool& pool,
+                    int max_concurrency = std::numeric_limits<int>::max())
+      : pool_(&pool), state_(std::make_shared<state>(max_concurrency)) {
+    if (max_concurrency < 1) {
+      throw std::invalid_argument("An executor needs a positive limit.");
+    }
+  }
+
+ public:
+  const Pool& pool() const {
+    return *pool_;
+  }
+
+  int max_concurrency() const {
+    return state_->max_concurrency;
+  }
+
+  template <class F, class... Args>
+  auto async(F&& f, Args&&... args) const
+      -> std::future<decltype(f(args...))> {
+    using return_t = decltype(f(args...));
+    // refuse before allocating; `post()` checks again.
+    pool_->check_accepting();
+    auto bind_func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+    using task_t = detail::pool_task<return_t, decltype(bind_func)>;
+    auto alloc = pool_->get_allocator();
+    std::shared_ptr<task_t> task =
+        std::allocate_shared<task_t>(alloc, alloc, std::move(bind_func));
+    std::future<return_t> fut = task->get_future();
+    submit([task]() -> void { (*task)(); });
+    return fut;
+  }
+
+ private:
+  void submit(std::function<void()> fn) const {
+    if (state_->max_concurrency == std::numeric_limits<int>::max()) {
+      pool_->post(std::move(fn));
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(state_->mtx);
+      if (state_->running == state_->max_concurrency) {
+        state_->pending.push_back(std::move(fn));
+        return;
+      }
+      ++state_->running;
+    }
+    try {
+      dispatch(pool_, state_, std::move(fn));
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(state_->mtx);
+      --state_->running;
+      throw;
+    }
+  }
+
+  static void dispatch(const Pool* pool, std::shared_ptr<state> st,
+                       std::function<void()> fn) {
+    pool->post([pool, st, fn = std::move(fn)]() mutable -> void {
+      fn();
+      finished(pool, std::move(st));
+    });
+  }
+
+  // keeps the slot of a finished task for the next pending one, if any.
+  static void finished(const Pool* pool, std::shared_ptr<state> st) {
+    for (;;) {
+      std::function<void()> next;
+      {
+        std::lock_guard<std::mutex> lock(st->mtx);
+        if (st->pending.empty()) {
+          --st->running;
+          return;
+        }
+        next = std::move(st->pending.front());
+        st->pending.pop_front();
+      }
+      try {
+        dispatch(pool, st, std::move(next));
+        return;
+      } catch (const std::runtime_error&) {
+        // the pool has stopped.
+        std::lock_guard<std::mutex> lock(st->mtx);
+        st->pending.clear();
+        --st->running;
+        return;
+      } catch (...) {
+        // e.g. out of memory: `next` is gone and its future reports a broken
+        // promise. Hand the slot to the one after it.
+      }
+    }
+  }
+
+ private:
+  const Pool* pool_;
+  std::shared_ptr<state> state_;
+};
+
+// a view of `default_pool()`.
+inline executor<threadpool<>> make_executor(
+    int max_concurrency = std::numeric_limits<int>::max()) {
+  return executor<threadpool<>>(default_pool(), max_concurrency);
+}
+}  // namespace yuuki
@@ -0,0 +1,456 @@
+// =========================================================================
+// Copyright 2022 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#pragma once
+
+#include <yuuki/cacheline.h>
+#include <yuuki/threadpool.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <future>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace yuuki {
+namespace detail {
+class tenant_ring;
+
+// What a `fair_queue` schedules a tenant by; its sub-queue lives in the
+// derived `tenant_state`.
+struct tenant_node {
+  tenant_node(unsigned w, int cap, tenant_ring* r)
+      : weight(w), max_concurrency(cap), ring(r) {
+  }
+
+  bool capped() const {
+    return max_concurrency != std::numeric_limits<int>::max();
+  }
+
+  bool at_cap() const {
+    return running.load(std::memory_order_acquire) >= max_concurrency;
+  }
+
+  // reserves a slot below the cap; released by the task when it finishes.
+  // With `keep_room`, only succeeds if the cap is not reached by it.
+  bool try_acquire(bool keep_room = false) {
+    if (!capped()) {
+      return true;
+    }
+    const int limit = keep_room ? max_concurrency - 1 : max_concurrency;
+    int cur = running.load(std::memory_order_relaxed);
+    while (cur < limit) {
+      if (running.compare_exchange_weak(cur, cur + 1,
+                                        std::memory_order_acq_rel)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void release();  // gives a slot back, see `tenant_ring::released`
+
+  const unsigned weight;
+  const int max_concurrency;
+  tenant_ring* const ring;
+  alignas(cacheline_size) std::atomic<int> running{0};
+  // what is left of its turn while it is at the cursor.
+  std::atomic<int> credits{0};
+  // tasks queued, readable without the sub-queue's lock.
+  std::atomic<size_t> pending{0};
+
+  // guarded by the ring's lock
+  bool linked{false};
+  tenant_node* prev{nullptr};
+  tenant_node* next{nullptr};
+};
+
+// The tenants that may run a task now, i.e. have tasks pending and are below
+// their cap, in the order they became runnable, and the cursor walking them.
+class tenant_ring {
+ public:
+  bool empty() const {
+    return cursor_.load(std::memory_order_seq_cst) == nullptr;
+  }
+
+  tenant_node* cursor() const {
+    return cursor_.load(std::memory_order_seq_cst);
+  }
+
+  // `t` got tasks, or got below its cap: link it unless it is already in.
+  void wake(tenant_node* t) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!t->linked && t->pending.load() != 0 && !t->at_cap()) {
+      link(t);
+    }
+  }
+
+  // holds `mtx`; a newcomer joins at the end of the current round.
+  void link(tenant_node* t) {
+    tenant_node* cur = cursor_.load(std::memory_order_relaxed);
+    if (cur == nullptr) {
+      t->prev = t->next = t;
+      t->credits.store(t->weight, std::memory_order_relaxed);
+      cursor_.store(t, std::memory_order_seq_cst);
+    } else {
+      t->next = cur;
+      t->prev = cur->prev;
+      cur->prev->next = t;
+      cur->prev = t;
+    }
+    t->linked = true;
+  }
+
+  // holds `mtx`
+  void unlink(tenant_node* t) {
+    tenant_node* cur = cursor_.load(std::memory_order_relaxed);
+    if (t->next == t) {
+      cursor_.store(nullptr, std::memory_order_seq_cst);
+    } else {
+      t->prev->next = t->next;
+      t->next->prev = t->prev;
+      if (cur == t) {
+        t->next->credits.store(t->next->weight, std::memory_order_relaxed);
+        cursor_.store(t->next, std::memory_order_seq_cst);
+      }
+    }
+    t->prev = t->next = nullptr;
+    t->linked = false;
+  }
+
+  // holds `mtx`
+  void advance() {
+    tenant_node* next = cursor_.load(std::memory_order_relaxed)->next;
+    next->credits.store(next->weight, std::memory_order_relaxed);
+    cursor_.store(next, std::memory_order_seq_cst);
+  }
+
+  std::mutex mtx;
+
+ private:
+  // changed under `mtx` only, read without it on the fast path of `pop`.
+  std::atomic<tenant_node*> cursor_{nullptr};
+};
+
+inline void tenant_node::release() {
+  // only the task that took the last slot can have seen it unlinked.
+  if (running.fetch_sub(1, std::memory_order_acq_rel) == max_concurrency) {
+    ring->wake(this);
+  }
+}
+
+template <typename Allocator>
+struct tenant_state : tenant_node {
+  using fn_allocator = typename std::allocator_traits<
+      Allocator>::template rebind_alloc<std::function<void()>>;
+
+  tenant_state(unsigned w, int cap, tenant_ring* r, const Allocator& alloc)
+      : tenant_node(w, cap, r), tasks(fn_allocator(alloc)) {
+  }
+
+  alignas(cacheline_size) std::mutex mtx;
+  std::deque<std::function<void()>, fn_allocator> tasks;  // guarded by `mtx`
+};
+}  // namespace detail
+
+// Element of a `fair_queue`: a task and, if its tenant has a concurrency cap,
+// the tenant whose slot it occupies until it has run.
+class tenant_task {
+ public:
+  tenant_task() = default;
+  template <typename F, typename = std::enable_if_t<
+                            !std::is_same_v<std::decay_t<F>, tenant_task>>>
+  tenant_task(F&& f)  // NOLINT(runtime/explicit)
+      : fn_(std::forward<F>(f)) {
+  }
+  tenant_task(detail::tenant_node* owner, std::function<void()> fn)
+      : owner_(owner), fn_(std::move(fn)) {
+  }
+
+ public:
+  void operator()() {
+    struct release {
+      detail::tenant_node* owner;
+      ~release() {
+        if (owner != nullptr) {
+          owner->release();
+        }
+      }
+    } guard{owner_};
+    fn_();
+  }
+
+ private:
+  detail::tenant_node* owner_{nullptr};
+  std::function<void()> fn_;
+};
+
+// Handle to a tenant of a pool running on a `fair_queue`; cheap to copy.
+// Tasks delegated through it are queued apart from other tenants' ones.
+template <typename Pool>
+class tenant {
+ public:
+  using state_type = typename Pool::queue_type::state_type;
+
+ public:
+  tenant(const Pool& pool, state_type* state) : pool_(&pool), state_(state) {
+  }
+
+ public:
+  unsigned weight() const {
+    return state_->weight;
+  }
+
+  int max_concurrency() const {
+    return state_->max_concurrency;
+  }
+
+  template <class F, class... Args>
+  auto async(F&& f, Args&&... args) const
+      -> std::future<decltype(f(args...))> {
+    using return_t = decltype(f(args...));
+    // refuse before allocating; `post()` checks again.
+    pool_->check_accepting();
+    auto bind_func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+    using task_t = detail::pool_task<return_t, decltype(bind_func)>;
+    auto alloc = pool_->get_allocator();
+    std::shared_ptr<task_t> task =
+        std::allocate_shared<task_t>(alloc, alloc, std::move(bind_func));
+    std::future<return_t> fut = task->get_future();
+    pool_->post(state_, [task]() -> void { (*task)(); });
+    return fut;
+  }
+
+ private:
+  const Pool* pool_;
+  state_type* state_;
+};
+
+// Task queue that shares the workers among tenants in proportion to their
+// weights (see `threadpool::make_tenant`).
+//
+// Every tenant has its own FIFO sub-queue. Tenants that may run a task, i.e.
+// have some pending and are below their concurrency cap, form a ring that
+// consumers walk in deficit round-robin where a task costs one unit: the
+// tenant at the cursor is served up to `weight` times in a row, then the
+// cursor moves on, so a dequeue is O(1) however many tenants exist or how
+// much one of them has queued. A tenant leaves the ring when it drains or
+// reaches its cap, and rejoins, at the end of the current round, when it gets
+// a task or one of its tasks finishes.
+//
+// Only changes to the ring take its lock: a dequeue that neither ends the
+// turn of the tenant at the cursor, nor drains it, nor takes its last slot
+// just locks that tenant's sub-queue. Submitting locks the sub-queue, plus
+// the ring when the tenant had nothing pending. Tasks delegated through plain
+// `async()` belong to a default tenant of weight 1 without a cap. Tenants
+// live as long as the queue does.
+template <typename Allocator = std::allocator<std::function<void()>>>
+class fair_queue {
+ public:
+  using value_type = tenant_task;
+  using allocator_type = Allocator;
+  using state_type = detail::tenant_state<Allocator>;
+
+ public:
+  fair_queue() : fair_queue(Allocator()) {
+  }
+  explicit fair_queue(const Allocator& alloc)
+      : alloc_(alloc),
+        default_(std::make_unique<state_type>(
+            1, std::numeric_limits<int>::max(), &ring_, alloc)) {
+  }
+  ~fair_queue() = default;
+  fair_queue(const fair_queue&) = delete;
+  fair_queue(fair_queue&&) = delete;
+  fair_queue& operator=(const fair_queue&) = delete;
+  fair_queue& operator=(fair_queue&&) = delete;
+
+ public:
+  allocator_type get_allocator() const {
+    return alloc_;
+  }
+
+  // whether no tenant may run a task now; tasks of tenants at their cap do
+  // not count.
+  bool empty() const {
+    return ring_.empty();
+  }
+
+  size_t size() const {
+    return size_.load(std::memory_order_relaxed);
+  }
+
+  // registers a tenant; `emplace(tenant, f)` queues a task of it.
+  state_type* add_tenant(
+      unsigned weight = 1,
+      int max_concurrency = std::numeric_limits<int>::max()) {
+    if (weight == 0 || max_concurrency < 1) {
+      throw std::invalid_argument(
+          "A tenant needs a positive weight and concurrency cap.");
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    tenants_.push_back(std::make_unique<state_type>(weight, max_concurrency,
+                                                    &ring_, alloc_));
+    return tenants_.back().get();
+  }
+
+  template <typename Pool, class... Args>
+  tenant<Pool> make_tenant(const Pool& pool, Args&&... args) {
+    return tenant<Pool>(pool, add_tenant(std::forward<Args>(args)...));
+  }
+
+ public:
+  // tenants at their cap are out of the ring, so visit every one.
+  void clear() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    std::lock_guard<std::mutex> rlock(ring_.mtx);
+    drop(default_.get());
+    for (auto& t : tenants_) {
+      drop(t.get());
+    }
+  }
+
+  // a task of the default tenant.
+  template <typename F>
+  void emplace(F&& f) {
+    push(default_.get(), std::forward<F>(f));
+  }
+
+  template <typename F>
+  void emplace(state_type* owner, F&& f) {
+    push(owner, std::forward<F>(f));
+  }
+
+  bool pop(tenant_task& holder) {
+    detail::tenant_node* n = ring_.cursor();
+    if (n == nullptr) {
+      return false;
+    }
+    return pop_cursor(n, holder) || pop_locked(holder);
+  }
+
+ private:
+  template <typename F>
+  void push(state_type* t, F&& f) {
+    size_t before;
+    {
+      std::lock_guard<std::mutex> tlock(t->mtx);
+      t->tasks.emplace_back(std::forward<F>(f));
+      before = t->pending.fetch_add(1);
+    }
+    size_.fetch_add(1, std::memory_order_relaxed);
+    if (before == 0) {
+      // a consumer that drained `t` unlinks it under the ring's lock, before
+      // this can link it again.
+      ring_.wake(t);
+    }
+  }
+
+  // The fast path: a task of the tenant at the cursor, if that changes
+  // nothing about the ring.
+  bool pop_cursor(detail::tenant_node* n, tenant_task& holder) {
+    int credits = n->credits.load(std::memory_order_relaxed);
+    if (credits <= 1 || !n->credits.compare_exchange_strong(
+                            credits, credits - 1, std::memory_order_acq_rel)) {
+      return false;
+    }
+    auto* t = static_cast<state_type*>(n);
+    if (t->try_acquire(true)) {
+      std::unique_lock<std::mutex> tlock(t->mtx);
+      if (t->tasks.size() > 1) {
+        take(t, holder);
+        return true;
+      }
+      tlock.unlock();
+      if (t->capped()) {
+        t->running.fetch_sub(1, std::memory_order_acq_rel);
+      }
+    }
+    t->credits.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  bool pop_locked(tenant_task& holder) {
+    std::lock_guard<std::mutex> lock(ring_.mtx);
+    while (detail::tenant_node* n = ring_.cursor()) {
+      if (n->credits.load(std::memory_order_relaxed) <= 0) {
+        ring_.advance();
+        continue;
+      }
+      auto* t = static_cast<state_type*>(n);
+      if (!t->try_acquire()) {
+        ring_.unlink(t);  // woken by the task that gives back a slot
+        continue;
+      }
+      bool drained;
+      {
+        std::lock_guard<std::mutex> tlock(t->mtx);
+        take(t, holder);
+        drained = t->tasks.empty();
+      }
+      t->credits.fetch_sub(1, std::memory_order_relaxed);
+      if (drained || t->at_cap()) {
+        ring_.unlink(t);
+      }
+      return true;
+    }
+    return false;
+  }
+
+  // holds `t->mtx`; `t` has a task and a slot for it.
+  void take(state_type* t, tenant_task& holder) {
+    std::function<void()> fn = std::move(t->tasks.front());
+    t->tasks.pop_front();
+    t->pending.fetch_sub(1);
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    holder = tenant_task(t->capped() ? t : nullptr, std::move(fn));
+  }
+
+  // holds `mtx_` and the ring's lock
+  void drop(state_type* t) {
+    std::lock_guard<std::mutex> tlock(t->mtx);
+    size_.fetch_sub(t->tasks.size(), std::memory_order_relaxed);
+    t->tasks.clear();
+    t->pending.store(0);
+    if (t->linked) {
+      ring_.unlink(t);
+    }
+  }
+
+ private:
+  const Allocator alloc_;
+  mutable detail::tenant_ring ring_;
+  std::unique_ptr<state_type> default_;
+  alignas(cacheline_size) std::atomic<size_t> size_{0};
+  // registration and `clear()` only, off the hot path.
+  alignas(cacheline_size) std::mutex mtx_;
+  std::vector<std::unique_ptr<state_type>> tenants_;  // guarded by `mtx_`
+};
+
+using fair_threadpool = threadpool<fair_queue<>>;
+
+namespace pmr {
+using fair_queue =
+    yuuki::fair_queue<std::pmr::polymorphic_allocator<std::function<void()>>>;
+}  // namespace pmr
+}  // namespace yuuki
@@ -0,0 +1,708 @@
+// =========================================================================
+// Copyright 2022 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#pragma once
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define YUUKI_HAS_IO_URING 1
+#else
+#define YUUKI_HAS_IO_URING 0
+#endif
+
+#if defined(__SANITIZE_THREAD__)
+// requests reach the reactor through memory written by the kernel, which
+// ThreadSanitizer cannot see; tell it about the hand-over.
+extern "C" void __tsan_acquire(void* addr);
+extern "C" void __tsan_release(void* addr);
+#define YUUKI_TSAN_ACQUIRE(addr) __tsan_acquire(addr)
+#define YUUKI_TSAN_RELEASE(addr) __tsan_release(addr)
+#else
+#define YUUKI_TSAN_ACQUIRE(addr)
+#define YUUKI_TSAN_RELEASE(addr)
+#endif
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace yuuki {
+// Asynchronous positional file I/O whose completions land on a threadpool.
+//
+// Requests go to the kernel through io_uring when it is available. A single
+// reactor thread reaps completions: futures are fulfilled right there, while
+// callbacks are delegated to the pool, so no pool worker ever sits in a
+// blocking `pread`/`pwrite`. Without io_uring (old kernels, seccomp, non-Linux)
+// a few private I/O threads run the blocking calls instead and hand their
+// completions to the same reactor.
+//
+// At most `queue_depth` requests are outstanding; further submissions block
+// until one completes. Requests are flushed to the kernel one by one unless a
+// `batch` is alive, in which case they go in a single `io_uring_enter`.
+// The pool must outlive the service.
+template <typename Pool>
+class io_service {
+ public:
+  enum class backend { io_uring, threads };
+
+ public:
+  // `backend::threads` forces the fallback even where io_uring works.
+  explicit io_service(const Pool& pool, unsigned queue_depth = 128,
+                      backend preferred = backend::io_uring);
+  ~io_service();
+  io_service(const io_service&) = delete;
+  io_service(io_service&&) = delete;
+  io_service& operator=(const io_service&) = delete;
+  io_service& operator=(io_service&&) = delete;
+
+ public:
+  backend get_backend() const {
+    return uring_fd_ >= 0 ? backend::io_uring : backend::threads;
+  }
+
+  unsigned queue_depth() const {
+    return depth_;
+  }
+
+  // Futures yield the number of bytes transferred or throw `std::system_error`;
+  // callbacks run on the pool with that number, or `-errno`, and on the
+  // reactor if the pool refuses them (it has stopped, or is out of memory).
+  // Nothing could catch what a callback throws there, so it must be
+  // `noexcept`. `len` may not exceed `UINT_MAX`.
+  // A submission that throws never completes.
+  std::future<size_t> read(int fd, void* buf, size_t len, off_t offset);
+  std::future<size_t> write(int fd, const void* buf, size_t len, off_t offset);
+
+  template <typename F>
+  void read(int fd, void* buf, size_t len, off_t offset, F&& callback);
+  template <typename F>
+  void write(int fd, const void* buf, size_t len, off_t offset, F&& callback);
+
+  // Registers `iov` with the kernel so that `read_fixed`/`write_fixed` on them
+  // skip per-request page pinning. `buf` must lie within `iov[buf_index]`.
+  // Replaces any previous registration; a no-op for the thread backend.
+  void register_buffers(const iovec* iov, unsigned n);
+  std::future<size_t> read_fixed(int fd, unsigned buf_index, void* buf,
+                                 size_t len, off_t offset);
+  std::future<size_t> write_fixed(int fd, unsigned buf_index, const void* buf,
+                                  size_t len, off_t offset);
+
+  // Defers flushing submissions to the kernel until the last live `batch`
+  // goes away. Should that flush fail, the requests stay queued and the next
+  // submission retries it, reporting the error then; those the destructor
+  // still cannot flush complete with the error.
+  class batch {
+   public:
+    explicit batch(io_service& io) : io_(io) {
+      io_.holds_.fetch_add(1, std::memory_order_relaxed);
+    }
+    ~batch() {
+      if (io_.holds_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::lock_guard<std::mutex> lock(io_.sq_mtx_);
+        try {
+          io_.flush();
+        } catch (const std::system_error&) {
+        }
+      }
+    }
+    batch(const batch&) = delete;
+    batch& operator=(const batch&) = delete;
+
+   private:
+    io_service& io_;
+  };
+
+ private:
+  enum class opcode : uint8_t { read, write, read_fixed, write_fixed, nop };
+
+  struct op {
+    opcode code;
+    int fd;
+    void* buf;
+    unsigned len;
+    off_t offset;
+    unsigned buf_index;
+    virtual ~op() = default;
+    virtual void complete(const Pool& pool, ssize_t res) = 0;
+  };
+
+  struct promise_op : op {
+    std::promise<size_t> promise;
+    void complete(const Pool&, ssize_t res) override {
+      if (res < 0) {
+        promise.set_exception(std::make_exception_ptr(std::system_error(
+            static_cast<int>(-res), std::generic_category())));
+      } else {
+        promise.set_value(static_cast<size_t>(res));
+      }
+    }
+  };
+
+  template <typename F>
+  struct callback_op : op {
+    explicit callback_op(F&& f) : callback(std::move(f)) {
+    }
+    F callback;
+    void complete(const Pool& pool, ssize_t res) override {
+      // shared, so that it is still ours if the pool refuses it.
+      std::shared_ptr<F> f;
+      try {
+        f = std::make_shared<F>(std::move(callback));
+        pool.post([f, res]() -> void { (*f)(res); });
+      } catch (...) {
+        // the pool has stopped, or is out of memory: the completion must not
+        // be lost, so it runs here.
+        f ? (*f)(res) : callback(res);
+      }
+    }
+  };
+
+ private:
+  std::future<size_t> submit_future(opcode code, int fd, void* buf, size_t len,
+                                    off_t offset, unsigned buf_index);
+  void submit(std::unique_ptr<op> o, opcode code, int fd, void* buf,
+              size_t len, off_t offset, unsigned buf_index);
+  void enqueue(op* o);  // holds `sq_mtx_`
+  void flush();         // holds `sq_mtx_`
+  op* retract();        // holds `sq_mtx_`
+  void finish(op* o, ssize_t res);
+  void release_slot();
+  void reactor();
+
+  bool setup_uring(unsigned entries);
+  void teardown_uring();
+  void io_worker();
+
+ private:
+  const Pool& pool_;
+  const unsigned depth_;
+
+  // outstanding requests, bounded by `depth_`
+  std::mutex slot_mtx_;
+  std::condition_variable slot_cond_;
+  unsigned in_flight_{0};
+
+  std::mutex sq_mtx_;
+  std::atomic<int> holds_{0};
+  unsigned unflushed_{0};
+
+  // io_uring backend
+  int uring_fd_{-1};
+  void* sq_ring_{nullptr};
+  size_t sq_ring_size_{0};
+  void* cq_ring_{nullptr};
+  size_t cq_ring_size_{0};
+  void* sqes_{nullptr};
+  size_t sqes_size_{0};
+  unsigned* sq_head_{nullptr};
+  unsigned* sq_tail_{nullptr};
+  unsigned sq_mask_{0};
+  unsigned sq_entries_{0};
+  unsigned* sq_array_{nullptr};
+  unsigned* cq_head_{nullptr};
+  unsigned* cq_tail_{nullptr};
+  unsigned cq_mask_{0};
+  void* cqes_{nullptr};
+
+  // thread backend
+  std::vector<std::thread> io_workers_;
+  std::deque<op*> requests_;
+  std::deque<std::pair<op*, ssize_t>> completions_;
+  std::condition_variable request_cond_;
+  std::condition_variable completion_cond_;
+  bool stopping_{false};  // guarded by `sq_mtx_`
+
+  std::thread reactor_;
+};
+
+template <typename Pool>
+inline io_service<Pool>::io_service(const Pool& pool, unsigned queue_depth,
+                                    backend preferred)
+    : pool_(pool), depth_(queue_depth == 0 ? 1 : queue_depth) {
+  if (preferred != backend::io_uring || !setup_uring(depth_)) {
+    const unsigned n = depth_ < 4 ? depth_ : 4;
+    for (unsigned i = 0; i != n; ++i) {
+      io_workers_.emplace_back(&io_service::io_worker, this);
+    }
+  }
+  reactor_ = std::thread(&io_service::reactor, this);
+}
+
+template <typename Pool>
+inline io_service<Pool>::~io_service() {
+  {
+    // requests a failed `batch` flush left queued would otherwise never
+    // complete; if they still cannot go out, fail them.
+    std::vector<op*> failed;
+    int err = 0;
+    {
+      std::lock_guard<std::mutex> lock(sq_mtx_);
+      try {
+        flush();
+      } catch (const std::system_error& e) {
+        err = e.code().value();
+        while (unflushed_ != 0) {
+          failed.push_back(retract());
+        }
+      }
+    }
+    for (op* o : failed) {
+      finish(o, -err);
+    }
+  }
+  {
+    std::unique_lock<std::mutex> lock(slot_mtx_);
+    slot_cond_.wait(lock, [this] { return in_flight_ == 0; });
+  }
+  {
+    std::lock_guard<std::mutex> lock(sq_mtx_);
+    stopping_ = true;
+    if (uring_fd_ >= 0) {
+      // a NOP without an `op` behind it tells the reactor to leave.
+      enqueue(nullptr);
+      flush();
+    }
+  }
+  request_cond_.notify_all();
+  completion_cond_.notify_all();
+  reactor_.join();
+  for (auto& worker : io_workers_) {
+    worker.join();
+  }
+  teardown_uring();
+}
+
+template <typename Pool>
+inline std::future<size_t> io_service<Pool>::read(int fd, void* buf,
+                                                  size_t len, off_t offset) {
+  return submit_future(opcode::read, fd, buf, len, offset, 0);
+}
+
+template <typename Pool>
+inline std::future<size_t> io_service<Pool>::write(int fd, const void* buf,
+                                                   size_t len, off_t offset) {
+  return submit_future(opcode::write, fd, const_cast<void*>(buf), len, offset,
+                       0);
+}
+
+template <typename Pool>
+inline std::future<size_t> io_service<Pool>::read_fixed(int fd,
+                                                        unsigned buf_index,
+                                                        void* buf, size_t len,
+                                                        off_t offset) {
+  return submit_future(opcode::read_fixed, fd, buf, len, offset, buf_index);
+}
+
+template <typename Pool>
+inline std::future<size_t> io_service<Pool>::write_fixed(int fd,
+                                                         unsigned buf_index,
+                                                         const void* buf,
+                                                         size_t len,
+                                                         off_t offset) {
+  return submit_future(opcode::write_fixed, fd, const_cast<void*>(buf), len,
+                       offset, buf_index);
+}
+
+template <typename Pool>
+template <typename F>
+inline void io_service<Pool>::read(int fd, void* buf, size_t len, off_t offset,
+                                   F&& callback) {
+  static_assert(std::is_nothrow_invocable_v<std::decay_t<F>&, ssize_t>,
+                "I/O callbacks must be noexcept.");
+  using op_t = callback_op<std::decay_t<F>>;
+  submit(std::make_unique<op_t>(std::decay_t<F>(std::forward<F>(callback))),
+         opcode::read, fd, buf, len, offset, 0);
+}
+
+template <typename Pool>
+template <typename F>
+inline void io_service<Pool>::write(int fd, const void* buf, size_t len,
+                                    off_t offset, F&& callback) {
+  static_assert(std::is_nothrow_invocable_v<std::decay_t<F>&, ssize_t>,
+                "I/O callbacks must be noexcept.");
+  using op_t = callback_op<std::decay_t<F>>;
+  submit(std::make_unique<op_t>(std::decay_t<F>(std::forward<F>(callback))),
+         opcode::write, fd, const_cast<void*>(buf), len, offset, 0);
+}
+
+template <typename Pool>
+inline void io_service<Pool>::register_buffers(const iovec* iov, unsigned n) {
+#if YUUKI_HAS_IO_URING
+  if (uring_fd_ < 0) {
+    return;
+  }
+  syscall(__NR_io_uring_register, uring_fd_, IORING_UNREGISTER_BUFFERS,
+          nullptr, 0);
+  if (syscall(__NR_io_uring_register, uring_fd_, IORING_REGISTER_BUFFERS, iov,
+              n) < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "io_uring_register(IORING_REGISTER_BUFFERS)");
+  }
+#else
+  (void)iov;
+  (void)n;
+#endif
+}
+
+template <typename Pool>
+inline std::future<size_t> io_service<Pool>::submit_future(
+    opcode code, int fd, void* buf, size_t len, off_t offset,
+    unsigned buf_index) {
+  auto o = std::make_unique<promise_op>();
+  std::future<size_t> fut = o->promise.get_future();
+  submit(std::move(o), code, fd, buf, len, offset, buf_index);
+  return fut;
+}
+
+template <typename Pool>
+inline void io_service<Pool>::submit(std::unique_ptr<op> o, opcode code,
+                                     int fd, void* buf, size_t len,
+                                     off_t offset, unsigned buf_index) {
+  if (len > UINT_MAX) {
+    // SQEs carry 32-bit lengths.
+    throw std::invalid_argument("I/O request longer than UINT_MAX bytes.");
+  }
+  o->code = code;
+  o->fd = fd;
+  o->buf = buf;
+  o->len = static_cast<unsigned>(len);
+  o->offset = offset;
+  o->buf_index = buf_index;
+  {
+    std::unique_lock<std::mutex> lock(slot_mtx_);
+    if (in_flight_ == depth_) {
+      // waiting on completions that may sit in an unflushed batch: flush.
+      lock.unlock();
+      {
+        std::lock_guard<std::mutex> sq_lock(sq_mtx_);
+        flush();
+      }
+      lock.lock();
+      slot_cond_.wait(lock, [this] { return in_flight_ < depth_; });
+    }
+    ++in_flight_;
+  }
+  std::lock_guard<std::mutex> lock(sq_mtx_);
+  bool queued = false;
+  try {
+    enqueue(o.get());
+    queued = true;
+    if (holds_.load(std::memory_order_acquire) == 0) {
+      flush();
+    }
+  } catch (...) {
+    // the kernel takes requests in order, so a failed flush left ours, the
+    // last one, queued: take it back, so that the caller sees the error but
+    // no completion.
+    if (queued) {
+      retract();
+    }
+    release_slot();
+    throw;
+  }
+  o.release();
+}
+
+template <typename Pool>
+inline void io_service<Pool>::enqueue(op* o) {
+#if YUUKI_HAS_IO_URING
+  if (uring_fd_ >= 0) {
+    const unsigned tail = *sq_tail_;
+    // `depth_` bounds what is in flight, but SQEs the kernel has not consumed
+    // yet still occupy the ring.
+    if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_) {
+      flush();
+    }
+    const unsigned index = tail & sq_mask_;
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes_) + index;
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = reinterpret_cast<uint64_t>(o);
+    if (o == nullptr) {
+      sqe->opcode = IORING_OP_NOP;
+    } else {
+      switch (o->code) {
+        case opcode::read: sqe->opcode = IORING_OP_READ; break;
+        case opcode::write: sqe->opcode = IORING_OP_WRITE; break;
+        case opcode::read_fixed: sqe->opcode = IORING_OP_READ_FIXED; break;
+        case opcode::write_fixed: sqe->opcode = IORING_OP_WRITE_FIXED; break;
+        case opcode::nop: sqe->opcode = IORING_OP_NOP; break;
+      }
+      sqe->fd = o->fd;
+      sqe->addr = reinterpret_cast<uint64_t>(o->buf);
+      sqe->len = o->len;
+      sqe->off = static_cast<uint64_t>(o->offset);
+      sqe->buf_index = static_cast<uint16_t>(o->buf_index);
+    }
+    sq_array_[index] = index;
+    YUUKI_TSAN_RELEASE(o);
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++unflushed_;
+    return;
+  }
+#endif
+  requests_.push_back(o);
+  ++unflushed_;
+}
+
+template <typename Pool>
+inline void io_service<Pool>::flush() {
+  if (unflushed_ == 0) {
+    return;
+  }
+#if YUUKI_HAS_IO_URING
+  if (uring_fd_ >= 0) {
+    while (unflushed_ != 0) {
+      const long ret =  // NOLINT(runtime/int)
+          syscall(__NR_io_uring_enter, uring_fd_, unflushed_, 0, 0, nullptr, 0);
+      if (ret < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+          continue;
+        }
+        throw std::system_error(errno, std::generic_category(),
+                                "io_uring_enter");
+      }
+      unflushed_ -= static_cast<unsigned>(ret);
+    }
+    return;
+  }
+#endif
+  unflushed_ = 0;
+  request_cond_.notify_all();
+}
+
+// Takes back the request enqueued last, which must not have been flushed.
+template <typename Pool>
+inline typename io_service<Pool>::op* io_service<Pool>::retract() {
+  --unflushed_;
+#if YUUKI_HAS_IO_URING
+  if (uring_fd_ >= 0) {
+    const unsigned tail = *sq_tail_ - 1;
+    const io_uring_sqe* sqe =
+        static_cast<io_uring_sqe*>(sqes_) + (tail & sq_mask_);
+    __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+    return reinterpret_cast<op*>(sqe->user_data);
+  }
+#endif
+  op* o = requests_.back();
+  requests_.pop_back();
+  return o;
+}
+
+template <typename Pool>
+inline void io_service<Pool>::finish(op* o, ssize_t res) {
+  o->complete(pool_, res);
+  delete o;
+  release_slot();
+}
+
+template <typename Pool>
+inline void io_service<Pool>::release_slot() {
+  {
+    std::lock_guard<std::mutex> lock(slot_mtx_);
+    --in_flight_;
+  }
+  slot_cond_.notify_all();
+}
+
+template <typename Pool>
+inline void io_service<Pool>::reactor() {
+#if YUUKI_HAS_IO_URING
+  if (uring_fd_ >= 0) {
+    const io_uring_cqe* cqes = static_cast<const io_uring_cqe*>(cqes_);
+    for (;;) {
+      unsigned head = *cq_head_;
+      const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      if (head == tail) {
+        syscall(__NR_io_uring_enter, uring_fd_, 0, 1, IORING_ENTER_GETEVENTS,
+                nullptr, 0);
+        continue;
+      }
+      bool stop = false;
+      for (; head != tail; ++head) {
+        const io_uring_cqe& cqe = cqes[head & cq_mask_];
+        op* o = reinterpret_cast<op*>(cqe.user_data);
+        const ssize_t res = cqe.res;
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        if (o == nullptr) {
+          stop = true;
+        } else {
+          YUUKI_TSAN_ACQUIRE(o);
+          finish(o, res);
+        }
+      }
+      if (stop) {
+        return;
+      }
+    }
+  }
+#endif
+  for (;;) {
+    std::pair<op*, ssize_t> done;
+    {
+      std::unique_lock<std::mutex> lock(sq_mtx_);
+      completion_cond_.wait(
+          lock, [this] { return stopping_ || !completions_.empty(); });
+      if (completions_.empty()) {
+        return;
+      }
+      done = completions_.front();
+      completions_.pop_front();
+    }
+    finish(done.first, done.second);
+  }
+}
+
+template <typename Pool>
+inline void io_service<Pool>::io_worker() {
+  for (;;) {
+    op* o;
+    {
+      std::unique_lock<std::mutex> lock(sq_mtx_);
+      request_cond_.wait(lock, [this] {
+        return stopping_ || (!requests_.empty() && unflushed_ == 0);
+      });
+      if (requests_.empty()) {
+        return;
+      }
+      o = requests_.front();
+      requests_.pop_front();
+    }
+    ssize_t res;
+    do {
+      res = (o->code == opcode::read || o->code == opcode::read_fixed)
+                ? ::pread(o->fd, o->buf, o->len, o->offset)
+                : ::pwrite(o->fd, o->buf, o->len, o->offset);
+    } while (res < 0 && errno == EINTR);
+    if (res < 0) {
+      res = -errno;
+    }
+    {
+      std::lock_guard<std::mutex> lock(sq_mtx_);
+      completions_.emplace_back(o, res);
+    }
+    completion_cond_.notify_one();
+  }
+}
+
+template <typename Pool>
+inline bool io_service<Pool>::setup_uring(unsigned entries) {
+#if YUUKI_HAS_IO_URING
+  io_uring_params p;
+  std::memset(&p, 0, sizeof(p));
+  // one extra CQ slot per request plus the shutdown NOP never overflows.
+  p.flags = IORING_SETUP_CQSIZE;
+  p.cq_entries = 2 * entries + 2;
+  const int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+  if (fd < 0) {
+    return false;
+  }
+  uring_fd_ = fd;
+  // plain `IORING_OP_READ`/`IORING_OP_WRITE` came with 5.6; this feature bit
+  // with 5.7 and is the cheapest way to tell.
+  if (!(p.features & IORING_FEAT_FAST_POLL)) {
+    teardown_uring();
+    return false;
+  }
+  sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+  const bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+  if (single && cq_ring_size_ > sq_ring_size_) {
+    sq_ring_size_ = cq_ring_size_;
+  }
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    sq_ring_ = nullptr;
+    teardown_uring();
+    return false;
+  }
+  if (single) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      cq_ring_ = nullptr;
+      teardown_uring();
+      return false;
+    }
+  }
+  sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+  sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (sqes_ == MAP_FAILED) {
+    sqes_ = nullptr;
+    teardown_uring();
+    return false;
+  }
+  char* sq = static_cast<char*>(sq_ring_);
+  char* cq = static_cast<char*>(cq_ring_);
+  sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+  sq_mask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+  sq_entries_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_entries);
+  sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+  cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+  cqes_ = cq + p.cq_off.cqes;
+  return true;
+#else
+  (void)entries;
+  return false;
+#endif
+}
+
+template <typename Pool>
+inline void io_service<Pool>::teardown_uring() {
+#if YUUKI_HAS_IO_URING
+  if (sqes_ != nullptr) {
+    munmap(sqes_, sqes_size_);
+  }
+  if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  if (sq_ring_ != nullptr) {
+    munmap(sq_ring_, sq_ring_size_);
+  }
+  if (uring_fd_ >= 0) {
+    close(uring_fd_);
+  }
+  sqes_ = cq_ring_ = sq_ring_ = nullptr;
+  uring_fd_ = -1;
+#endif
+}
+}  // namespace yuuki
@@ -0,0 +1,385 @@
+// =========================================================================
+// Copyright 2022 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#pragma once
+
+#include <yuuki/cacheline.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace yuuki {
+// Unbounded lock-free multi-producer/multi-consumer queue; a drop-in for
+// `threadsafe_queue`, e.g. as the task queue of a `threadpool`.
+//
+// Elements live in a linked list of fixed-size segments. Producers claim a
+// slot of the tail segment with a fetch-and-add on its enqueue index and
+// consumers one of the head segment with a fetch-and-add on its dequeue
+// index, so in the common case an operation costs one contended atomic
+// instead of a lock handoff. A consumer that overtakes a slow producer marks
+// the slot as taken and the producer retries with a fresh slot. A full tail
+// gets a new segment linked behind it; a drained head is unlinked and
+// retired. Retired segments are reclaimed with hazard pointers: every
+// operation publishes the segment it works on in a hazard record of this
+// queue, and a retired segment is only released once no record points to it.
+template <typename T, typename Allocator = std::allocator<T>>
+class lockfree_queue {
+ public:
+  using value_type = T;
+  using allocator_type = Allocator;
+
+ private:
+  static constexpr size_t kSegmentSize = 512;
+
+  enum slot_state : uint8_t { kEmpty, kReady, kTaken };
+
+  struct slot {
+    std::atomic<uint8_t> state{kEmpty};
+    alignas(T) unsigned char storage[sizeof(T)];
+
+    T* value() {
+      return std::launder(reinterpret_cast<T*>(storage));
+    }
+  };
+
+  struct segment {
+    alignas(cacheline_size) std::atomic<size_t> enq_idx{0};
+    alignas(cacheline_size) std::atomic<size_t> deq_idx{0};
+    alignas(cacheline_size) std::atomic<segment*> next{nullptr};
+    segment* retired_next{nullptr};
+    slot slots[kSegmentSize];
+  };
+
+  struct alignas(cacheline_size) hazard_record {
+    std::atomic<segment*> hazard{nullptr};
+    std::atomic<bool> active{false};
+    hazard_record* next{nullptr};
+  };
+
+  // holds a hazard record for the scope of one operation, so that none is
+  // leaked when constructing or moving an element throws.
+  class record_guard {
+   public:
+    explicit record_guard(const lockfree_queue& q)
+        : q_(q), rec_(q.acquire_record()) {
+    }
+    ~record_guard() {
+      q_.release_record(rec_);
+    }
+    record_guard(const record_guard&) = delete;
+    record_guard& operator=(const record_guard&) = delete;
+
+    hazard_record* get() const {
+      return rec_;
+    }
+
+   private:
+    const lockfree_queue& q_;
+    hazard_record* rec_;
+  };
+
+  using segment_allocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<segment>;
+  using segment_traits = std::allocator_traits<segment_allocator>;
+  using value_traits = std::allocator_traits<Allocator>;
+
+ public:
+  lockfree_queue() : lockfree_queue(Allocator()) {
+  }
+  explicit lockfree_queue(const Allocator& alloc)
+      : alloc_(alloc), seg_alloc_(alloc), id_(next_id()) {
+    segment* s = make_segment();
+    head_.store(s, std::memory_order_relaxed);
+    tail_.store(s, std::memory_order_relaxed);
+  }
+  ~lockfree_queue() {
+    for (segment* s = head_.load(std::memory_order_acquire); s != nullptr;) {
+      segment* next = s->next.load(std::memory_order_relaxed);
+      drop_segment(s, true);
+      s = next;
+    }
+    for (segment* s = retired_.load(std::memory_order_acquire); s != nullptr;) {
+      segment* next = s->retired_next;
+      drop_segment(s, false);
+      s = next;
+    }
+    for (hazard_record* r = records_.load(std::memory_order_acquire);
+         r != nullptr;) {
+      hazard_record* next = r->next;
+      delete r;
+      r = next;
+    }
+  }
+  lockfree_queue(const lockfree_queue&) = delete;
+  lockfree_queue(lockfree_queue&&) = delete;
+  lockfree_queue& operator=(const lockfree_queue&) = delete;
+  lockfree_queue& operator=(lockfree_queue&&) = delete;
+
+ public:
+  allocator_type get_allocator() const {
+    return alloc_;
+  }
+
+  // only a snapshot when called concurrently with producers or consumers.
+  bool empty() const {
+    record_guard rec(*this);
+    segment* h = protect(head_, rec.get());
+    return h->deq_idx.load(std::memory_order_acquire) >=
+               h->enq_idx.load(std::memory_order_acquire) &&
+           h->next.load(std::memory_order_acquire) == nullptr;
+  }
+
+ public:
+  void clear() {
+    T holder;
+    while (pop(holder)) {
+    }
+  }
+
+  void push(T obj) {
+    record_guard rec(*this);
+    for (;;) {
+      segment* t = protect(tail_, rec.get());
+      const size_t idx = t->enq_idx.fetch_add(1, std::memory_order_acq_rel);
+      if (idx >= kSegmentSize) {
+        grow(t);
+        continue;
+      }
+      slot& s = t->slots[idx];
+      // if this throws, the slot stays empty and consumers skip it.
+      value_traits::construct(alloc_, s.value(), std::move(obj));
+      uint8_t expected = kEmpty;
+      if (s.state.compare_exchange_strong(expected, kReady,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+        return;
+      }
+      // a consumer gave up on this slot already; take the value back.
+      obj = std::move(*s.value());
+      value_traits::destroy(alloc_, s.value());
+    }
+  }
+
+  template <typename... Args>
+  void emplace(Args&&... args) {
+    push(T(std::forward<Args>(args)...));
+  }
+
+  bool pop(T& holder) {
+    record_guard rec(*this);
+    for (;;) {
+      segment* h = protect(head_, rec.get());
+      if (h->deq_idx.load(std::memory_order_acquire) >=
+              h->enq_idx.load(std::memory_order_acquire) &&
+          h->next.load(std::memory_order_acquire) == nullptr) {
+        return false;
+      }
+      const size_t idx = h->deq_idx.fetch_add(1, std::memory_order_acq_rel);
+      if (idx >= kSegmentSize) {
+        segment* next = h->next.load(std::memory_order_acquire);
+        if (next == nullptr) {
+          return false;
+        }
+        // `tail_` must never point to a retired segment: help it along first.
+        segment* expected = h;
+        tail_.compare_exchange_strong(expected, next,
+                                      std::memory_order_acq_rel);
+        expected = h;
+        if (head_.compare_exchange_strong(expected, next,
+                                          std::memory_order_acq_rel)) {
+          rec.get()->hazard.store(nullptr, std::memory_order_release);
+          retire(h);
+        }
+        continue;
+      }
+      slot& s = h->slots[idx];
+      if (s.state.exchange(kTaken, std::memory_order_acq_rel) == kReady) {
+        holder = std::move(*s.value());
+        value_traits::destroy(alloc_, s.value());
+        return true;
+      }
+      // the producer of this slot has not finished; it will retry elsewhere.
+    }
+  }
+
+ private:
+  static uint64_t next_id() {
+    static std::atomic<uint64_t> id{1};
+    return id.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  segment* make_segment() {
+    segment* s = segment_traits::allocate(seg_alloc_, 1);
+    ::new (static_cast<void*>(s)) segment();
+    return s;
+  }
+
+  // destroys what producers left in `s` if `live`, i.e. on destruction.
+  void drop_segment(segment* s, bool live) {
+    if (live) {
+      const size_t end = std::min(s->enq_idx.load(std::memory_order_relaxed),
+                                  kSegmentSize);
+      for (size_t i = 0; i != end; ++i) {
+        if (s->slots[i].state.load(std::memory_order_relaxed) == kReady) {
+          value_traits::destroy(alloc_, s->slots[i].value());
+        }
+      }
+    }
+    s->~segment();
+    segment_traits::deallocate(seg_alloc_, s, 1);
+  }
+
+  // the tail segment `t` is full: link a new one behind it or catch up.
+  void grow(segment* t) {
+    if (t != tail_.load(std::memory_order_acquire)) {
+      return;
+    }
+    segment* next = t->next.load(std::memory_order_acquire);
+    if (next == nullptr) {
+      segment* fresh = make_segment();
+      if (t->next.compare_exchange_strong(next, fresh,
+                                          std::memory_order_acq_rel)) {
+        tail_.compare_exchange_strong(t, fresh, std::memory_order_acq_rel);
+        return;
+      }
+      drop_segment(fresh, false);
+    }
+    tail_.compare_exchange_strong(t, next, std::memory_order_acq_rel);
+  }
+
+  // Hazard records are claimed per operation; each thread remembers the one
+  // it used last for this queue, which is nearly always free again.
+  hazard_record* acquire_record() const {
+    struct hint {
+      uint64_t id{0};
+      hazard_record* rec{nullptr};
+    };
+    static thread_local hint last;
+    if (last.id == id_ &&
+        !last.rec->active.exchange(true, std::memory_order_acquire)) {
+      return last.rec;
+    }
+    for (hazard_record* r = records_.load(std::memory_order_acquire);
+         r != nullptr; r = r->next) {
+      if (!r->active.load(std::memory_order_relaxed) &&
+          !r->active.exchange(true, std::memory_order_acquire)) {
+        last = {id_, r};
+        return r;
+      }
+    }
+    hazard_record* r = new hazard_record;
+    r->active.store(true, std::memory_order_relaxed);
+    r->next = records_.load(std::memory_order_relaxed);
+    while (!records_.compare_exchange_weak(r->next, r,
+                                           std::memory_order_acq_rel)) {
+    }
+    num_records_.fetch_add(1, std::memory_order_relaxed);
+    last = {id_, r};
+    return r;
+  }
+
+  void release_record(hazard_record* rec) const {
+    rec->hazard.store(nullptr, std::memory_order_release);
+    rec->active.store(false, std::memory_order_release);
+  }
+
+  static segment* protect(const std::atomic<segment*>& src,
+                          hazard_record* rec) {
+    segment* s = src.load(std::memory_order_acquire);
+    for (;;) {
+      rec->hazard.store(s, std::memory_order_seq_cst);
+      segment* again = src.load(std::memory_order_seq_cst);
+      if (again == s) {
+        return s;
+      }
+      s = again;
+    }
+  }
+
+  void retire(segment* s) {
+    push_retired(s);
+    const size_t threshold =
+        2 * num_records_.load(std::memory_order_relaxed) + 4;
+    if (retired_count_.fetch_add(1, std::memory_order_acq_rel) + 1 >=
+        threshold) {
+      scan();
+    }
+  }
+
+  void push_retired(segment* s) {
+    s->retired_next = retired_.load(std::memory_order_relaxed);
+    while (!retired_.compare_exchange_weak(s->retired_next, s,
+                                           std::memory_order_acq_rel)) {
+    }
+  }
+
+  // releases every retired segment that no hazard record points to.
+  void scan() {
+    segment* list = retired_.exchange(nullptr, std::memory_order_acq_rel);
+    if (list == nullptr) {
+      return;
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::vector<segment*> hazards;
+    for (hazard_record* r = records_.load(std::memory_order_acquire);
+         r != nullptr; r = r->next) {
+      if (segment* h = r->hazard.load(std::memory_order_seq_cst)) {
+        hazards.push_back(h);
+      }
+    }
+    std::sort(hazards.begin(), hazards.end());
+    size_t released = 0;
+    while (list != nullptr) {
+      segment* s = list;
+      list = s->retired_next;
+      if (std::binary_search(hazards.begin(), hazards.end(), s)) {
+        push_retired(s);
+      } else {
+        drop_segment(s, false);
+        ++released;
+      }
+    }
+    retired_count_.fetch_sub(released, std::memory_order_acq_rel);
+  }
+
+ private:
+  alignas(cacheline_size) std::atomic<segment*> head_{nullptr};
+  alignas(cacheline_size) std::atomic<segment*> tail_{nullptr};
+  alignas(cacheline_size) mutable std::atomic<hazard_record*> records_{nullptr};
+  mutable std::atomic<size_t> num_records_{0};
+  std::atomic<segment*> retired_{nullptr};
+  std::atomic<size_t> retired_count_{0};
+  // segments are allocated by producers and released by consumers
+  // concurrently, so the allocator has to be thread-safe.
+  Allocator alloc_;
+  segment_allocator seg_alloc_;
+  const uint64_t id_;
+};
+
+namespace pmr {
+template <typename T>
+using lockfree_queue =
+    yuuki::lockfree_queue<T, std::pmr::polymorphic_allocator<T>>;
+}  // namespace pmr
+}  // namespace yuuki
@@ -0,0 +1,336 @@
+// =========================================================================
+// Copyright 2022 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#pragma once
+
+#include <yuuki/cacheline.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Parallel counterparts of a few standard algorithms, running on an existing
+// pool. Inputs are cut into blocks of about `kBlockBytes`, small enough to
+// stay in the L2 cache while a block is worked on. Blocks are not tasks: a
+// handful of helper tasks, at most one per worker, and the calling thread
+// claim block indices from a shared counter until none are left, so the pool
+// sees O(workers) tasks whatever the size of the input. Since the caller takes
+// part and only waits for blocks that are already running, these may be
+// called from inside the pool's own tasks, and still finish if the pool is
+// busy or stopped. Inputs of a single block run serially on the caller.
+// Iterators must be random access; the first exception thrown by an element
+// function is rethrown once all running blocks are done.
+namespace yuuki {
+namespace detail {
+inline constexpr size_t kBlockBytes = 64 * 1024;
+
+template <typename T>
+constexpr size_t block_size() {
+  return std::max<size_t>(kBlockBytes / sizeof(T), 1);
+}
+
+// workers to plan for: those started so far, or the machine's if a lazily
+// started pool has none yet.
+template <typename Pool>
+size_t pool_concurrency(const Pool& pool) {
+  const int size = pool.size();
+  if (size > 0) {
+    return size;
+  }
+  return std::max(std::thread::hardware_concurrency(), 1U);
+}
+
+struct block_loop {
+  block_loop(size_t n, std::function<void(size_t)> f)
+      : num_blocks(n), fn(std::move(f)) {
+  }
+
+  // claims and runs blocks until none are left.
+  void work() {
+    for (;;) {
+      const size_t b = next.fetch_add(1, std::memory_order_relaxed);
+      if (b >= num_blocks) {
+        return;
+      }
+      if (!failed.load(std::memory_order_relaxed)) {
+        try {
+          fn(b);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(mtx);
+          if (!error) {
+            error = std::current_exception();
+          }
+          failed.store(true, std::memory_order_relaxed);
+        }
+      }
+      if (done.fetch_add(1, std::memory_order_acq_rel) + 1 == num_blocks) {
+        std::lock_guard<std::mutex> lock(mtx);
+        cond.notify_all();
+      }
+    }
+  }
+
+  const size_t num_blocks;
+  // only called on a claimed block, i.e. while the caller still waits.
+  const std::function<void(size_t)> fn;
+  alignas(cacheline_size) std::atomic<size_t> next{0};
+  alignas(cacheline_size) std::atomic<size_t> done{0};
+  std::atomic<bool> failed{false};
+  std::mutex mtx;
+  std::condition_variable cond;
+  std::exception_ptr error;  // guarded by `mtx`
+};
+
+// Runs `fn(b)` for every `b` in `[0, num_blocks)` on `pool` and the caller.
+template <typename Pool, typename F>
+void for_each_block(const Pool& pool, size_t num_blocks, F&& fn) {
+  if (num_blocks == 0) {
+    return;
+  }
+  if (num_blocks == 1) {
+    fn(0);
+    return;
+  }
+  // helpers that start late find no block left and return at once; they only
+  // touch the shared state, never the caller's frame.
+  auto loop = std::make_shared<block_loop>(num_blocks, std::forward<F>(fn));
+  const size_t helpers = std::min(pool_concurrency(pool), num_blocks - 1);
+  try {
+    for (size_t i = 0; i != helpers; ++i) {
+      pool.post([loop]() -> void { loop->work(); });
+    }
+  } catch (const std::runtime_error&) {
+    // the pool has stopped; the caller does the rest.
+  }
+  loop->work();
+  std::unique_lock<std::mutex> lock(loop->mtx);
+  loop->cond.wait(lock, [&loop] {
+    return loop->done.load(std::memory_order_acquire) == loop->num_blocks;
+  });
+  if (loop->error) {
+    std::rethrow_exception(loop->error);
+  }
+}
+
+template <typename T>
+size_t num_blocks(size_t n) {
+  return (n + block_size<T>() - 1) / block_size<T>();
+}
+
+// Co-rank of a stable merge: the number of elements that the first `k`
+// outputs of merging `[a, a + m)` and `[b, b + n)` take from `a`.
+template <typename It, typename Compare>
+size_t merge_split(It a, size_t m, It b, size_t n, size_t k, Compare& comp) {
+  size_t lo = k > n ? k - n : 0;
+  size_t hi = std::min(k, m);
+  while (lo < hi) {
+    const size_t i = lo + (hi - lo) / 2;
+    // `a[i]` goes before `b[k - i - 1]`: take more from `a`.
+    if (!comp(b[k - i - 1], a[i])) {
+      lo = i + 1;
+    } else {
+      hi = i;
+    }
+  }
+  return lo;
+}
+
+// merges the runs of `width` elements of `[src, src + n)` pairwise into
+// `dst`, every output block on its own. The split points are all located
+// before anything is moved from `src`.
+template <typename Pool, typename Src, typename Dst, typename Compare>
+void merge_pass(const Pool& pool, Src src, Dst dst, size_t n, size_t width,
+                size_t block, Compare& comp) {
+  const size_t pair = 2 * width;
+  const size_t per_pair = (pair + block - 1) / block;
+  const size_t pairs = (n + pair - 1) / pair;
+  // the output range of block `b` within its pair, empty past the end.
+  auto bounds = [&](size_t b, size_t& base, size_t& len, size_t& lo,
+                    size_t& hi) {
+    base = b / per_pair * pair;
+    len = std::min(pair, n - base);
+    lo = std::min(b % per_pair * block, len);
+    hi = std::min(lo + block, len);
+  };
+  std::vector<size_t> splits(pairs * per_pair);
+  for_each_block(pool, splits.size(), [&](size_t b) {
+    size_t base, len, lo, hi;
+    bounds(b, base, len, lo, hi);
+    const size_t m = std::min(width, len);
+    splits[b] = merge_split(src + base, m, src + base + m, len - m, lo, comp);
+  });
+  for_each_block(pool, splits.size(), [&](size_t b) {
+    size_t base, len, lo, hi;
+    bounds(b, base, len, lo, hi);
+    if (lo == hi) {
+      return;
+    }
+    const size_t m = std::min(width, len);
+    const size_t i0 = splits[b];
+    const size_t i1 = hi == len ? m : splits[b + 1];
+    Src a = src + base;
+    Src c = a + m;
+    std::merge(std::make_move_iterator(a + i0), std::make_move_iterator(a + i1),
+               std::make_move_iterator(c + (lo - i0)),
+               std::make_move_iterator(c + (hi - i1)), dst + base + lo, comp);
+  });
+}
+}  // namespace detail
+
+// `std::transform` on `pool`.
+template <typename Pool, typename InputIt, typename OutputIt,
+          typename UnaryOperation>
+OutputIt parallel_transform(const Pool& pool, InputIt first, InputIt last,
+                            OutputIt d_first, UnaryOperation op) {
+  using T = typename std::iterator_traits<InputIt>::value_type;
+  const size_t n = std::distance(first, last);
+  const size_t block = detail::block_size<T>();
+  detail::for_each_block(pool, detail::num_blocks<T>(n), [&](size_t b) {
+    const size_t lo = b * block;
+    const size_t hi = std::min(lo + block, n);
+    std::transform(first + lo, first + hi, d_first + lo, op);
+  });
+  return d_first + n;
+}
+
+// `std::inclusive_scan` on `pool`; `op` must be associative. Every block is
+// reduced, the block sums are scanned serially, then every block is scanned
+// from its offset, so the input is read twice. May run in place.
+template <typename Pool, typename InputIt, typename OutputIt,
+          typename BinaryOperation = std::plus<>>
+OutputIt parallel_inclusive_scan(const Pool& pool, InputIt first, InputIt last,
+                                 OutputIt d_first,
+                                 BinaryOperation op = BinaryOperation()) {
+  using T = typename std::iterator_traits<InputIt>::value_type;
+  const size_t n = std::distance(first, last);
+  const size_t blocks = detail::num_blocks<T>(n);
+  if (blocks <= 1) {
+    return std::inclusive_scan(first, last, d_first, op);
+  }
+  const size_t block = detail::block_size<T>();
+  std::vector<T> sums(blocks);
+  // the last block's sum is never needed.
+  detail::for_each_block(pool, blocks - 1, [&](size_t b) {
+    const size_t lo = b * block;
+    sums[b] = std::accumulate(first + lo + 1, first + lo + block,
+                              T(first[lo]), op);
+  });
+  for (size_t b = 1; b + 1 < blocks; ++b) {
+    sums[b] = op(sums[b - 1], sums[b]);
+  }
+  detail::for_each_block(pool, blocks, [&](size_t b) {
+    const size_t lo = b * block;
+    const size_t hi = std::min(lo + block, n);
+    if (b == 0) {
+      std::inclusive_scan(first, first + hi, d_first, op);
+    } else {
+      std::inclusive_scan(first + lo, first + hi, d_first + lo, op,
+                          sums[b - 1]);
+    }
+  });
+  return d_first + n;
+}
+
+// `std::copy_if` on `pool`; keeps the order. Every block counts its matches,
+// then copies them to its offset, so `pred` is called twice per element and
+// has to give the same answer both times.
+template <typename Pool, typename InputIt, typename OutputIt,
+          typename UnaryPredicate>
+OutputIt parallel_copy_if(const Pool& pool, InputIt first, InputIt last,
+                          OutputIt d_first, UnaryPredicate pred) {
+  using T = typename std::iterator_traits<InputIt>::value_type;
+  const size_t n = std::distance(first, last);
+  const size_t blocks = detail::num_blocks<T>(n);
+  if (blocks <= 1) {
+    return std::copy_if(first, last, d_first, pred);
+  }
+  const size_t block = detail::block_size<T>();
+  std::vector<size_t> offsets(blocks + 1, 0);
+  detail::for_each_block(pool, blocks, [&](size_t b) {
+    const size_t lo = b * block;
+    const size_t hi = std::min(lo + block, n);
+    offsets[b + 1] = std::count_if(first + lo, first + hi, pred);
+  });
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+  detail::for_each_block(pool, blocks, [&](size_t b) {
+    const size_t lo = b * block;
+    const size_t hi = std::min(lo + block, n);
+    std::copy_if(first + lo, first + hi, d_first + offsets[b], pred);
+  });
+  return d_first + offsets[blocks];
+}
+
+// Sorts `[first, last)` on `pool`; not stable. A merge sort: one run per
+// worker (a power of two of them) is sorted with `std::sort`, then the runs
+// are merged pairwise, ping-ponging with a buffer from the pool's allocator.
+// Every merge pass is cut into output blocks located by binary search, so
+// all workers stay busy up to the last pass, at the cost of reading and
+// writing the whole input once per pass. The elements have to be default
+// constructible.
+template <typename Pool, typename RandomIt, typename Compare = std::less<>>
+void parallel_sort(const Pool& pool, RandomIt first, RandomIt last,
+                   Compare comp = Compare()) {
+  using T = typename std::iterator_traits<RandomIt>::value_type;
+  const size_t n = std::distance(first, last);
+  const size_t block = detail::block_size<T>();
+  size_t runs = 1;
+  while (runs < detail::pool_concurrency(pool) && n / (2 * runs) >= block) {
+    runs *= 2;
+  }
+  if (runs == 1) {
+    std::sort(first, last, comp);
+    return;
+  }
+  const size_t width = (n + runs - 1) / runs;
+  detail::for_each_block(pool, runs, [&](size_t r) {
+    const size_t lo = std::min(r * width, n);
+    const size_t hi = std::min(lo + width, n);
+    std::sort(first + lo, first + hi, comp);
+  });
+
+  using alloc_t = typename std::allocator_traits<
+      typename Pool::allocator_type>::template rebind_alloc<T>;
+  std::vector<T, alloc_t> buffer(n, alloc_t(pool.get_allocator()));
+  bool in_buffer = false;
+  for (size_t w = width; w < n; w *= 2) {
+    if (in_buffer) {
+      detail::merge_pass(pool, buffer.begin(), first, n, w, block, comp);
+    } else {
+      detail::merge_pass(pool, first, buffer.begin(), n, w, block, comp);
+    }
+    in_buffer = !in_buffer;
+  }
+  if (in_buffer) {
+    detail::for_each_block(pool, detail::num_blocks<T>(n), [&](size_t b) {
+      const size_t lo = b * block;
+      const size_t hi = std::min(lo + block, n);
+      std::move(buffer.begin() + lo, buffer.begin() + hi, first + lo);
+    });
+  }
+}
+}  // namespace yuuki
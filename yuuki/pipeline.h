@@ -0,0 +1,457 @@
+// =========================================================================
+// Copyright 2022 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace yuuki {
+enum class stage_mode {
+  serial_in_order,      // one item at a time, in the order the source made them
+  serial_out_of_order,  // one item at a time, in any order
+  parallel,             // any number of items at a time
+};
+
+// handed to the source of a pipeline; call `stop()` to signal that there is
+// no more input. The value returned alongside is discarded.
+class flow_control {
+ public:
+  void stop() {
+    stopped_ = true;
+  }
+  bool stopped() const {
+    return stopped_;
+  }
+
+ private:
+  bool stopped_{false};
+};
+
+namespace detail {
+// An item in flight is identified by its token, an index into the per-stage
+// slot arrays, so values move between stages without allocating. Scheduling
+// still costs one pool task per call of the source and per item handed to a
+// serial stage that was busy.
+class stage_base {
+ public:
+  using entry = std::pair<size_t, size_t>;  // (seq, token)
+
+ public:
+  explicit stage_base(stage_mode mode) : mode_(mode) {
+  }
+  virtual ~stage_base() = default;
+  stage_base(const stage_base&) = delete;
+  stage_base& operator=(const stage_base&) = delete;
+
+ public:
+  stage_mode mode() const {
+    return mode_;
+  }
+
+  // consumes the input slot of `token` and fills the output slot; returns
+  // false if this is the source and it has run dry.
+  virtual bool process(size_t token) = 0;
+  virtual void reset() = 0;
+
+ public:
+  // bookkeeping of serial stages, owned by the running pipeline.
+  std::mutex mtx;
+  bool busy{false};
+  size_t next_seq{0};
+  std::priority_queue<entry, std::vector<entry>, std::greater<entry>> pending;
+
+ private:
+  const stage_mode mode_;
+};
+
+template <typename Out>
+class stage_output : public stage_base {
+ public:
+  stage_output(stage_mode mode, size_t tokens)
+      : stage_base(mode), slots(tokens) {
+  }
+  void reset() override {
+    for (auto& slot : slots) {
+      slot.reset();
+    }
+  }
+
+ public:
+  std::vector<std::optional<Out>> slots;
+};
+
+template <>
+class stage_output<void> : public stage_base {
+ public:
+  stage_output(stage_mode mode, size_t) : stage_base(mode) {
+  }
+  void reset() override {
+  }
+};
+
+template <typename Out, typename F>
+class source_stage : public stage_output<Out> {
+ public:
+  source_stage(size_t tokens, F f)
+      : stage_output<Out>(stage_mode::serial_in_order, tokens),
+        f_(std::move(f)) {
+  }
+  bool process(size_t token) override {
+    if (fc_.stopped()) {
+      return false;
+    }
+    Out value = f_(fc_);
+    if (fc_.stopped()) {
+      return false;
+    }
+    this->slots[token].emplace(std::move(value));
+    return true;
+  }
+  void reset() override {
+    stage_output<Out>::reset();
+    fc_ = flow_control();
+  }
+
+ private:
+  F f_;
+  flow_control fc_;
+};
+
+template <typename In, typename Out, typename F>
+class filter_stage : public stage_output<Out> {
+ public:
+  filter_stage(stage_mode mode, size_t tokens, stage_output<In>* prev, F f)
+      : stage_output<Out>(mode, tokens), prev_(prev), f_(std::move(f)) {
+  }
+  bool process(size_t token) override {
+    std::optional<In>& in = prev_->slots[token];
+    if constexpr (std::is_void_v<Out>) {
+      f_(std::move(*in));
+    } else {
+      this->slots[token].emplace(f_(std::move(*in)));
+    }
+    in.reset();
+    return true;
+  }
+
+ private:
+  stage_output<In>* const prev_;
+  F f_;
+};
+
+// Scheduling state of a single `pipeline::run`, shared with the tasks it
+// delegates to the pool.
+template <typename Pool>
+class pipeline_run : public std::enable_shared_from_this<pipeline_run<Pool>> {
+ public:
+  pipeline_run(const Pool& pool, const std::vector<stage_base*>& stages,
+               size_t tokens)
+      : pool_(pool), stages_(stages) {
+    free_tokens_.reserve(tokens);
+    for (size_t i = 0; i != tokens; ++i) {
+      free_tokens_.push_back(tokens - 1 - i);
+    }
+  }
+
+ public:
+  void start() {
+    spawn_source();
+  }
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(mtx_);
+    done_.wait(lock, [this] { return source_done_ && in_flight_ == 0; });
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+
+ private:
+  // runs the source on the pool if it is idle and a token is free.
+  void spawn_source() {
+    size_t token;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      if (source_done_ || source_busy_ || free_tokens_.empty()) {
+        return;
+      }
+      token = free_tokens_.back();
+      free_tokens_.pop_back();
+      source_busy_ = true;
+      ++in_flight_;
+    }
+    auto self = this->shared_from_this();
+    try {
+      pool_.post([self, token]() -> void { self->run_source(token); });
+    } catch (...) {
+      // the pool has stopped: there will be no more items.
+      fail(std::current_exception());
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        source_busy_ = false;
+        source_done_ = true;
+      }
+      release(token);
+    }
+  }
+
+  void run_source(size_t token) {
+    const bool more = invoke(0, token);
+    size_t seq = 0;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      source_busy_ = false;
+      if (more) {
+        seq = next_seq_++;
+      } else {
+        source_done_ = true;
+      }
+    }
+    if (!more) {
+      release(token);
+      return;
+    }
+    spawn_source();
+    advance(token, seq, 1);
+  }
+
+  // carries an item through stages [s, end); parks it and returns when a
+  // serial stage is not ready for it.
+  void advance(size_t token, size_t seq, size_t s) {
+    for (; s != stages_.size(); ++s) {
+      stage_base* stage = stages_[s];
+      if (stage->mode() != stage_mode::parallel) {
+        std::lock_guard<std::mutex> lock(stage->mtx);
+        const bool ready =
+            !stage->busy && (stage->mode() == stage_mode::serial_out_of_order ||
+                             seq == stage->next_seq);
+        if (!ready) {
+          stage->pending.emplace(seq, token);
+          return;
+        }
+        stage->busy = true;
+      }
+      invoke(s, token);
+      if (stage->mode() != stage_mode::parallel) {
+        finish_serial(s);
+      }
+    }
+    release(token);
+  }
+
+  // hands serial stage `s` to the next parked item that may enter it.
+  void finish_serial(size_t s) {
+    stage_base* stage = stages_[s];
+    stage_base::entry next;
+    {
+      std::lock_guard<std::mutex> lock(stage->mtx);
+      if (stage->mode() == stage_mode::serial_in_order) {
+        ++stage->next_seq;
+      }
+      if (stage->pending.empty() ||
+          (stage->mode() == stage_mode::serial_in_order &&
+           stage->pending.top().first != stage->next_seq)) {
+        stage->busy = false;
+        return;
+      }
+      next = stage->pending.top();
+      stage->pending.pop();
+    }
+    auto self = this->shared_from_this();
+    auto hop = [self, s, next]() -> void {
+      self->invoke(s, next.second);
+      self->finish_serial(s);
+      self->advance(next.second, next.first, s + 1);
+    };
+    try {
+      pool_.post(hop);
+    } catch (...) {
+      // the pool has stopped: the run has failed, so the item only passes
+      // through, but it must, to free the stage and its token.
+      fail(std::current_exception());
+      hop();
+    }
+  }
+
+  void release(size_t token) {
+    bool done;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      free_tokens_.push_back(token);
+      --in_flight_;
+      done = source_done_ && in_flight_ == 0;
+      if (done) {
+        done_.notify_all();
+      }
+    }
+    if (!done) {
+      spawn_source();
+    }
+  }
+
+  // once a stage has thrown, the remaining items still flow through the
+  // serial stages (to keep their order bookkeeping intact) but do no work.
+  bool invoke(size_t s, size_t token) {
+    if (failed_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    try {
+      return stages_[s]->process(token);
+    } catch (...) {
+      fail(std::current_exception());
+      return false;
+    }
+  }
+
+  void fail(std::exception_ptr error) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!error_) {
+      error_ = std::move(error);
+    }
+    failed_.store(true, std::memory_order_release);
+  }
+
+ private:
+  const Pool& pool_;
+  const std::vector<stage_base*> stages_;
+  std::mutex mtx_;
+  std::condition_variable done_;
+  std::vector<size_t> free_tokens_;
+  size_t in_flight_{0};
+  size_t next_seq_{0};
+  bool source_busy_{false};
+  bool source_done_{false};
+  std::atomic<bool> failed_{false};
+  std::exception_ptr error_;
+};
+}  // namespace detail
+
+// A chain of stages run on a threadpool, in the style of TBB's
+// `parallel_pipeline`. At most `tokens` items are in flight at once; serial
+// stages buffer the items they are not ready for, which is therefore bounded
+// by `tokens` as well.
+//
+//   auto p = yuuki::make_pipeline(16, [&](yuuki::flow_control& fc) { ... })
+//                .then(yuuki::stage_mode::parallel, transform)
+//                .then(yuuki::stage_mode::serial_in_order, write);
+//   p.run(pool);
+//
+// `Out` is the type produced by the last stage so far; only a pipeline whose
+// last stage returns `void` can be run.
+template <typename Out>
+class pipeline {
+ public:
+  pipeline(pipeline&&) = default;
+  pipeline& operator=(pipeline&&) = default;
+  pipeline(const pipeline&) = delete;
+  pipeline& operator=(const pipeline&) = delete;
+
+ public:
+  template <typename F>
+  auto then(stage_mode mode, F&& f) && -> pipeline<
+      std::invoke_result_t<std::decay_t<F>&, std::add_rvalue_reference_t<Out>>>;
+
+  // blocks until the source has stopped and every item has left the last
+  // stage; rethrows the first exception thrown by a stage, or by the pool
+  // refusing work (e.g. once stopped). Must not be called concurrently with
+  // itself. Called from a worker of `pool`, it blocks that worker, and
+  // deadlocks if no other worker is free to run the stages.
+  template <typename Pool>
+  void run(const Pool& pool);
+
+ private:
+  template <typename>
+  friend class pipeline;
+  template <typename F>
+  friend auto make_pipeline(size_t tokens, F&& f) -> pipeline<
+      std::invoke_result_t<std::decay_t<F>&, flow_control&>>;
+
+  pipeline(std::vector<std::unique_ptr<detail::stage_base>> stages,
+           detail::stage_output<Out>* last, size_t tokens)
+      : stages_(std::move(stages)), last_(last), tokens_(tokens) {
+  }
+
+ private:
+  std::vector<std::unique_ptr<detail::stage_base>> stages_;
+  detail::stage_output<Out>* last_;
+  size_t tokens_;
+};
+
+// starts a pipeline with `f(flow_control&)` as its (serial) source.
+template <typename F>
+inline auto make_pipeline(size_t tokens, F&& f)
+    -> pipeline<std::invoke_result_t<std::decay_t<F>&, flow_control&>> {
+  using out_t = std::invoke_result_t<std::decay_t<F>&, flow_control&>;
+  using stage_t = detail::source_stage<out_t, std::decay_t<F>>;
+  static_assert(!std::is_void_v<out_t>,
+                "a pipeline source must return a value");
+  if (tokens == 0) {
+    throw std::invalid_argument("A pipeline needs at least one token.");
+  }
+  auto stage = std::make_unique<stage_t>(tokens, std::forward<F>(f));
+  detail::stage_output<out_t>* last = stage.get();
+  std::vector<std::unique_ptr<detail::stage_base>> stages;
+  stages.emplace_back(std::move(stage));
+  return pipeline<out_t>(std::move(stages), last, tokens);
+}
+
+template <typename Out>
+template <typename F>
+inline auto pipeline<Out>::then(stage_mode mode, F&& f) && -> pipeline<
+    std::invoke_result_t<std::decay_t<F>&, std::add_rvalue_reference_t<Out>>> {
+  static_assert(!std::is_void_v<Out>, "no stage may follow a void stage");
+  using next_t = std::invoke_result_t<std::decay_t<F>&,
+                                      std::add_rvalue_reference_t<Out>>;
+  using stage_t = detail::filter_stage<Out, next_t, std::decay_t<F>>;
+  auto stage =
+      std::make_unique<stage_t>(mode, tokens_, last_, std::forward<F>(f));
+  detail::stage_output<next_t>* last = stage.get();
+  stages_.emplace_back(std::move(stage));
+  return pipeline<next_t>(std::move(stages_), last, tokens_);
+}
+
+template <typename Out>
+template <typename Pool>
+inline void pipeline<Out>::run(const Pool& pool) {
+  static_assert(std::is_void_v<Out>, "the last stage must return void");
+  std::vector<detail::stage_base*> stages;
+  stages.reserve(stages_.size());
+  for (auto& stage : stages_) {
+    stage->reset();
+    stage->busy = false;
+    stage->next_seq = 0;
+    stage->pending = {};
+    stages.push_back(stage.get());
+  }
+  auto state =
+      std::make_shared<detail::pipeline_run<Pool>>(pool, stages, tokens_);
+  state->start();
+  state->wait();
+}
+}  // namespace yuuki
@@ -0,0 +1,158 @@
+// =========================================================================
+// Copyright 2022 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+namespace yuuki {
+// Bump allocator for short-lived scratch memory; not thread-safe.
+//
+// Allocations advance a pointer through a list of chunks taken from
+// `upstream`; deallocations are no-ops. `rewind()` hands back everything
+// allocated since a `mark()` and `reset()` everything at all, without
+// returning the chunks, so an arena that is reset after each unit of work
+// stops touching `upstream` once it has seen its peak. A reset that finds
+// more than one chunk replaces them by a single one of their total size.
+// Objects living in the arena must be destroyed before the memory they occupy
+// is handed back.
+class scratch_arena : public std::pmr::memory_resource {
+ public:
+  // a position to `rewind()` to.
+  struct marker {
+    size_t chunk;
+    size_t offset;
+  };
+
+ private:
+  struct chunk {
+    std::byte* data;
+    size_t size;
+  };
+
+ public:
+  explicit scratch_arena(
+      size_t initial_size = 64 * 1024,
+      std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+      : upstream_(upstream), next_size_(std::max<size_t>(initial_size, 64)) {
+  }
+  ~scratch_arena() override {
+    release();
+  }
+  scratch_arena(const scratch_arena&) = delete;
+  scratch_arena& operator=(const scratch_arena&) = delete;
+
+ public:
+  marker mark() const {
+    return {current_, offset_};
+  }
+
+  void rewind(marker m) {
+    current_ = m.chunk;
+    offset_ = m.offset;
+  }
+
+  void reset() {
+    if (chunks_.size() > 1) {
+      size_t total = 0;
+      for (auto& c : chunks_) {
+        total += c.size;
+      }
+      release();
+      add_chunk(total);
+    }
+    current_ = 0;
+    offset_ = 0;
+  }
+
+  // returns every chunk to `upstream`.
+  void release() {
+    for (auto& c : chunks_) {
+      upstream_->deallocate(c.data, c.size, alignof(std::max_align_t));
+    }
+    chunks_.clear();
+    current_ = 0;
+    offset_ = 0;
+  }
+
+  // bytes taken from `upstream` and not yet returned.
+  size_t capacity() const {
+    size_t res = 0;
+    for (auto& c : chunks_) {
+      res += c.size;
+    }
+    return res;
+  }
+
+  std::pmr::memory_resource* upstream_resource() const {
+    return upstream_;
+  }
+
+ private:
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    for (; current_ < chunks_.size(); ++current_, offset_ = 0) {
+      if (void* p = carve(chunks_[current_], bytes, alignment)) {
+        return p;
+      }
+    }
+    // chunks are aligned to `max_align_t`; over-aligned requests need slack.
+    const size_t slack =
+        alignment > alignof(std::max_align_t) ? alignment : 0;
+    add_chunk(std::max(next_size_, bytes + slack));
+    current_ = chunks_.size() - 1;
+    offset_ = 0;
+    return carve(chunks_[current_], bytes, alignment);
+  }
+
+  void do_deallocate(void*, size_t, size_t) override {
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept
+      override {
+    return this == &other;
+  }
+
+  void* carve(const chunk& c, size_t bytes, size_t alignment) {
+    const auto base = reinterpret_cast<std::uintptr_t>(c.data);
+    const std::uintptr_t p =
+        (base + offset_ + alignment - 1) & ~(alignment - 1);
+    if (p + bytes > base + c.size) {
+      return nullptr;
+    }
+    offset_ = p + bytes - base;
+    return reinterpret_cast<void*>(p);
+  }
+
+  void add_chunk(size_t size) {
+    auto* data = static_cast<std::byte*>(
+        upstream_->allocate(size, alignof(std::max_align_t)));
+    chunks_.push_back({data, size});
+    next_size_ = std::max(next_size_, 2 * size);
+  }
+
+ private:
+  std::pmr::memory_resource* upstream_;
+  std::vector<chunk> chunks_;
+  size_t current_{0};  // chunk being carved from
+  size_t offset_{0};   // into `chunks_[current_]`
+  size_t next_size_;
+};
+}  // namespace yuuki
@@ -0,0 +1,360 @@
+// =========================================================================
+// Copyright 2022 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#pragma once
+
+#include <yuuki/cacheline.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <utility>
+
+namespace yuuki {
+// Bounded wait-free single-producer/single-consumer ring.
+//
+// Exactly one thread may call the producer side (`push`, `emplace`, `push_n`)
+// and exactly one thread the consumer side (`pop`, `pop_n`) at a time. Each
+// side keeps a private copy of the other side's index and only re-reads the
+// shared one when the copy says the ring is full (resp. empty), so in steady
+// state the two indices' cache lines are not ping-ponged on every operation.
+template <typename T, typename Allocator = std::allocator<T>>
+class spsc_queue {
+ public:
+  using value_type = T;
+  using allocator_type = Allocator;
+
+ private:
+  using traits = std::allocator_traits<Allocator>;
+
+ public:
+  explicit spsc_queue(size_t capacity, const Allocator& alloc = Allocator())
+      : mask_(round_up(capacity < 2 ? 2 : capacity) - 1),
+        alloc_(alloc),
+        buf_(traits::allocate(alloc_, mask_ + 1)) {
+  }
+  ~spsc_queue() {
+    clear();
+    traits::deallocate(alloc_, buf_, mask_ + 1);
+  }
+  spsc_queue(const spsc_queue&) = delete;
+  spsc_queue(spsc_queue&&) = delete;
+  spsc_queue& operator=(const spsc_queue&) = delete;
+  spsc_queue& operator=(spsc_queue&&) = delete;
+
+ public:
+  allocator_type get_allocator() const {
+    return alloc_;
+  }
+
+  size_t capacity() const {
+    return mask_ + 1;
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  // only a snapshot when called concurrently with either side.
+  size_t size() const {
+    const size_t head = head_.load(std::memory_order_acquire);
+    const size_t tail = tail_.load(std::memory_order_acquire);
+    return tail - head;
+  }
+
+ public:
+  // consumer side; must not race with `pop`.
+  void clear() {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    const size_t tail = tail_.load(std::memory_order_acquire);
+    for (size_t i = head; i != tail; ++i) {
+      traits::destroy(alloc_, &buf_[i & mask_]);
+    }
+    tail_cache_ = tail;
+    head_.store(tail, std::memory_order_release);
+  }
+
+  bool push(const T& obj) {
+    return emplace(obj);
+  }
+
+  bool push(T&& obj) {
+    return emplace(std::move(obj));
+  }
+
+  template <typename... Args>
+  bool emplace(Args&&... args) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ == capacity()) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ == capacity()) {
+        return false;
+      }
+    }
+    traits::construct(alloc_, &buf_[tail & mask_],
+                      std::forward<Args>(args)...);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // pushes up to `n` elements from `first` with a single publication;
+  // returns how many were pushed. Should a copy throw, none of the batch is
+  // pushed.
+  template <typename InputIt>
+  size_t push_n(InputIt first, size_t n) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (capacity() - (tail - head_cache_) < n) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+    }
+    const size_t room = capacity() - (tail - head_cache_);
+    if (n > room) {
+      n = room;
+    }
+    size_t i = 0;
+    try {
+      for (; i != n; ++i, ++first) {
+        traits::construct(alloc_, &buf_[(tail + i) & mask_], *first);
+      }
+    } catch (...) {
+      // unpublished, so the consumer has not seen them.
+      while (i != 0) {
+        --i;
+        traits::destroy(alloc_, &buf_[(tail + i) & mask_]);
+      }
+      throw;
+    }
+    if (n != 0) {
+      tail_.store(tail + n, std::memory_order_release);
+    }
+    return n;
+  }
+
+  bool pop(T& holder) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_) {
+        return false;
+      }
+    }
+    T& slot = buf_[head & mask_];
+    holder = std::move(slot);
+    traits::destroy(alloc_, &slot);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // pops up to `n` elements into `out` with a single publication; returns how
+  // many were popped.
+  template <typename OutputIt>
+  size_t pop_n(OutputIt out, size_t n) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (tail_cache_ - head < n) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+    }
+    const size_t avail = tail_cache_ - head;
+    if (n > avail) {
+      n = avail;
+    }
+    for (size_t i = 0; i != n; ++i, ++out) {
+      T& slot = buf_[(head + i) & mask_];
+      *out = std::move(slot);
+      traits::destroy(alloc_, &slot);
+    }
+    if (n != 0) {
+      head_.store(head + n, std::memory_order_release);
+    }
+    return n;
+  }
+
+ private:
+  static size_t round_up(size_t n) {
+    if (n > std::numeric_limits<size_t>::max() / 2 + 1) {
+      throw std::length_error("spsc_queue capacity too large.");
+    }
+    size_t res = 1;
+    while (res < n) {
+      res <<= 1;
+    }
+    return res;
+  }
+
+ private:
+  // consumer-owned line
+  alignas(cacheline_size) std::atomic<size_t> head_{0};
+  size_t tail_cache_{0};
+  // producer-owned line
+  alignas(cacheline_size) std::atomic<size_t> tail_{0};
+  size_t head_cache_{0};
+  // read-only after construction
+  alignas(cacheline_size) const size_t mask_;
+  Allocator alloc_;
+  T* const buf_;
+};
+
+// Blocking wrapper around `spsc_queue`, meant to connect two pipeline stages.
+//
+// Operations only touch the lock when the ring is full (producer) or empty
+// (consumer), or when the other side is known to be parked. After `close()`,
+// `push` fails and `pop` drains what is left, then fails.
+template <typename T, typename Allocator = std::allocator<T>>
+class spsc_channel {
+ public:
+  using wlock = std::unique_lock<std::shared_mutex>;
+  using rlock = std::shared_lock<std::shared_mutex>;
+  using value_type = T;
+  using allocator_type = Allocator;
+
+ public:
+  explicit spsc_channel(size_t capacity, const Allocator& alloc = Allocator())
+      : queue_(capacity, alloc) {
+  }
+  ~spsc_channel() = default;
+  spsc_channel(const spsc_channel&) = delete;
+  spsc_channel(spsc_channel&&) = delete;
+  spsc_channel& operator=(const spsc_channel&) = delete;
+  spsc_channel& operator=(spsc_channel&&) = delete;
+
+ public:
+  size_t capacity() const {
+    return queue_.capacity();
+  }
+
+  bool empty() const {
+    return queue_.empty();
+  }
+
+  size_t size() const {
+    return queue_.size();
+  }
+
+  bool closed() const {
+    return closed_.load(std::memory_order_acquire);
+  }
+
+ public:
+  void close() {
+    closed_.store(true, std::memory_order_seq_cst);
+    wlock lock(mtx_);
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+
+  bool try_push(T obj) {
+    if (closed() || !queue_.push(std::move(obj))) {
+      return false;
+    }
+    wakeup(consumer_waiting_, not_empty_);
+    return true;
+  }
+
+  // blocks while the channel is full; returns false if it has been closed.
+  bool push(T obj) {
+    if (closed()) {
+      return false;
+    }
+    if (!queue_.push(std::move(obj))) {
+      wlock lock(mtx_);
+      bool pushed = false;
+      not_full_.wait(lock, [this, &obj, &pushed] {
+        park(producer_waiting_);
+        pushed = !closed() && queue_.push(std::move(obj));
+        return pushed || closed();
+      });
+      producer_waiting_.store(false, std::memory_order_relaxed);
+      if (!pushed) {
+        return false;
+      }
+    }
+    wakeup(consumer_waiting_, not_empty_);
+    return true;
+  }
+
+  bool try_pop(T& holder) {
+    if (!queue_.pop(holder)) {
+      return false;
+    }
+    wakeup(producer_waiting_, not_full_);
+    return true;
+  }
+
+  // blocks while the channel is empty; returns false once it has been closed
+  // and drained.
+  bool pop(T& holder) {
+    if (!queue_.pop(holder)) {
+      wlock lock(mtx_);
+      bool popped = false;
+      not_empty_.wait(lock, [this, &holder, &popped] {
+        park(consumer_waiting_);
+        // load `closed_` first: everything pushed before `close()` is then
+        // visible to the `pop` that follows.
+        const bool is_closed = closed();
+        popped = queue_.pop(holder);
+        return popped || is_closed;
+      });
+      consumer_waiting_.store(false, std::memory_order_relaxed);
+      if (!popped) {
+        return false;
+      }
+    }
+    wakeup(producer_waiting_, not_full_);
+    return true;
+  }
+
+ private:
+  // The parked side (re-)raises its flag under `mtx_` and fences before every
+  // re-check of the ring; `wakeup` fences after updating it, so one of the two
+  // sees the other. Only the first `wakeup` after a park pays for the notify.
+  void park(std::atomic<bool>& waiting) {
+    waiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+
+  void wakeup(std::atomic<bool>& waiting, std::condition_variable_any& cond) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting.load(std::memory_order_relaxed) &&
+        waiting.exchange(false, std::memory_order_relaxed)) {
+      {
+        wlock lock(mtx_);
+      }
+      cond.notify_one();
+    }
+  }
+
+ private:
+  spsc_queue<T, Allocator> queue_;
+  std::atomic<bool> closed_{false};
+  std::atomic<bool> producer_waiting_{false};
+  std::atomic<bool> consumer_waiting_{false};
+  std::shared_mutex mtx_;
+  std::condition_variable_any not_empty_;
+  std::condition_variable_any not_full_;
+};
+
+namespace pmr {
+template <typename T>
+using spsc_queue = yuuki::spsc_queue<T, std::pmr::polymorphic_allocator<T>>;
+template <typename T>
+using spsc_channel = yuuki::spsc_channel<T, std::pmr::polymorphic_allocator<T>>;
+}  // namespace pmr
+}  // namespace yuuki
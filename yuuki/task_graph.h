@@ -0,0 +1,259 @@
+// =========================================================================
+// Copyright 2022 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace yuuki {
+// A DAG of tasks, declared once and run on a threadpool any number of times.
+//
+//   yuuki::task_graph g;
+//   auto a = g.emplace([]() { ... });
+//   auto b = g.emplace([]() { ... });
+//   g.precede(a, b);  // `b` starts after `a` has finished
+//   g.run(pool);
+//
+// Every node carries an atomic count of unfinished predecessors. The worker
+// that finishes a node decrements its successors' counts, keeps one of the
+// nodes that become ready for itself and delegates the others to the pool, so
+// no worker ever blocks on another node. The successor lists are flattened on
+// the first `run` after a change; later runs only reset the counters.
+class task_graph {
+ public:
+  using node = size_t;
+
+ public:
+  task_graph() = default;
+  ~task_graph() = default;
+  task_graph(const task_graph&) = delete;
+  task_graph(task_graph&&) = delete;
+  task_graph& operator=(const task_graph&) = delete;
+  task_graph& operator=(task_graph&&) = delete;
+
+ public:
+  size_t size() const {
+    return works_.size();
+  }
+
+  template <typename F>
+  node emplace(F&& f) {
+    works_.emplace_back(std::forward<F>(f));
+    successors_.emplace_back();
+    dirty_ = true;
+    return works_.size() - 1;
+  }
+
+  // `to` runs only after `from` has finished.
+  void precede(node from, node to) {
+    if (from >= size() || to >= size()) {
+      throw std::out_of_range("Linking a node that is not in the task graph.");
+    }
+    successors_[from].push_back(to);
+    dirty_ = true;
+  }
+
+  // blocks until every node has run; rethrows the first exception thrown by a
+  // node, or by the pool refusing one (e.g. once stopped), in which case nodes
+  // that had not started yet are skipped. Must not be called concurrently with
+  // itself or with changes to the graph, nor from a worker of `pool` unless
+  // another worker is free to run the nodes.
+  template <typename Pool>
+  void run(const Pool& pool);
+
+ private:
+  void freeze();
+
+  // false if the pool refused `n`, which the caller then has to execute.
+  template <typename Pool>
+  bool schedule(const Pool& pool, node n);
+
+  template <typename Pool>
+  void execute(const Pool& pool, node n);
+
+  void fail(std::exception_ptr error);
+
+ private:
+  // as declared
+  std::vector<std::function<void()>> works_;
+  std::vector<std::vector<node>> successors_;
+  bool dirty_{false};
+
+  // flattened by `freeze()`: successors of `n` are
+  // `succ_[succ_begin_[n], succ_begin_[n + 1])`.
+  std::vector<size_t> succ_begin_;
+  std::vector<node> succ_;
+  std::vector<size_t> num_preds_;
+  std::vector<node> roots_;
+  std::unique_ptr<std::atomic<size_t>[]> join_;
+
+  // per run
+  std::atomic<size_t> remaining_{0};
+  std::atomic<bool> failed_{false};
+  std::exception_ptr error_;
+  bool finished_{false};  // guarded by `mtx_`
+  std::mutex mtx_;
+  std::condition_variable done_;
+};
+
+inline void task_graph::freeze() {
+  const size_t n = size();
+  succ_begin_.assign(n + 1, 0);
+  num_preds_.assign(n, 0);
+  for (node i = 0; i != n; ++i) {
+    succ_begin_[i + 1] = succ_begin_[i] + successors_[i].size();
+    for (node s : successors_[i]) {
+      ++num_preds_[s];
+    }
+  }
+  succ_.clear();
+  succ_.reserve(succ_begin_[n]);
+  roots_.clear();
+  for (node i = 0; i != n; ++i) {
+    succ_.insert(succ_.end(), successors_[i].begin(), successors_[i].end());
+    if (num_preds_[i] == 0) {
+      roots_.push_back(i);
+    }
+  }
+  join_.reset(new std::atomic<size_t>[n]);
+
+  // Kahn's algorithm on a scratch copy: a cycle would make `run` hang.
+  std::vector<size_t> preds(num_preds_);
+  std::vector<node> ready(roots_);
+  size_t visited = 0;
+  while (!ready.empty()) {
+    node i = ready.back();
+    ready.pop_back();
+    ++visited;
+    for (size_t k = succ_begin_[i]; k != succ_begin_[i + 1]; ++k) {
+      if (--preds[succ_[k]] == 0) {
+        ready.push_back(succ_[k]);
+      }
+    }
+  }
+  if (visited != n) {
+    throw std::invalid_argument("The task graph contains a cycle.");
+  }
+  dirty_ = false;
+}
+
+template <typename Pool>
+inline void task_graph::run(const Pool& pool) {
+  if (dirty_) {
+    freeze();
+  }
+  if (size() == 0) {
+    return;
+  }
+  for (node i = 0; i != size(); ++i) {
+    join_[i].store(num_preds_[i], std::memory_order_relaxed);
+  }
+  error_ = nullptr;
+  finished_ = false;
+  failed_.store(false, std::memory_order_relaxed);
+  remaining_.store(size(), std::memory_order_release);
+  // roots the pool refused are only counted down, but must be: nodes already
+  // scheduled may be running.
+  std::vector<node> refused;
+  for (node r : roots_) {
+    if (!schedule(pool, r)) {
+      refused.push_back(r);
+    }
+  }
+  for (node r : refused) {
+    execute(pool, r);
+  }
+  std::unique_lock<std::mutex> lock(mtx_);
+  done_.wait(lock, [this] { return finished_; });
+  if (error_) {
+    std::rethrow_exception(error_);
+  }
+}
+
+template <typename Pool>
+inline bool task_graph::schedule(const Pool& pool, node n) {
+  try {
+    // no future: `execute` reports through `fail()` itself.
+    pool.post([this, &pool, n]() -> void { execute(pool, n); });
+    return true;
+  } catch (...) {
+    fail(std::current_exception());
+    return false;
+  }
+}
+
+inline void task_graph::fail(std::exception_ptr error) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (!error_) {
+    error_ = std::move(error);
+  }
+  failed_.store(true, std::memory_order_release);
+}
+
+template <typename Pool>
+inline void task_graph::execute(const Pool& pool, node n) {
+  // Once `remaining_` is decremented, `run` may return and the graph go away:
+  // from then on only locals may be touched.
+  const node none = size();
+  std::vector<node> refused;  // ready, but the pool would not take them
+  for (;;) {
+    if (!failed_.load(std::memory_order_acquire)) {
+      try {
+        works_[n]();
+      } catch (...) {
+        fail(std::current_exception());
+      }
+    }
+    // keep the first successor that becomes ready, delegate the rest.
+    node next = none;
+    for (size_t k = succ_begin_[n]; k != succ_begin_[n + 1]; ++k) {
+      const node s = succ_[k];
+      if (join_[s].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        if (next == none) {
+          next = s;
+        } else if (!schedule(pool, s)) {
+          refused.push_back(s);
+        }
+      }
+    }
+    if (next == none && !refused.empty()) {
+      next = refused.back();
+      refused.pop_back();
+    }
+    if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      // `run` may return as soon as we unlock.
+      std::lock_guard<std::mutex> lock(mtx_);
+      finished_ = true;
+      done_.notify_all();
+      return;
+    }
+    if (next == none) {
+      return;
+    }
+    n = next;
+  }
+}
+}  // namespace yuuki
@@ -18,29 +18,170 @@
 #pragma once
 
 #include <yuuki/blocking_queue.h>
+#include <yuuki/cacheline.h>
+#include <yuuki/scratch_arena.h>
 #include <yuuki/threadsafe_queue.h>
 
+#include <atomic>
 #include <condition_variable>
+#include <cstddef>
+#include <exception>
 #include <functional>
 #include <future>
 #include <memory>
+#include <memory_resource>
 #include <mutex>
 #include <queue>
 #include <shared_mutex>
 #include <stdexcept>
 #include <thread>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
 namespace yuuki {
-template <typename QueueType = threadsafe_queue<std::function<void()>>>
+namespace detail {
+// `std::packaged_task` lost its allocator support in C++17 while
+// `std::promise` kept it, so rebuild the former on top of the latter.
+template <typename R, typename F>
+class pool_task {
+ public:
+  template <typename Allocator>
+  pool_task(const Allocator& alloc, F&& f)
+      : promise_(std::allocator_arg, alloc), f_(std::move(f)) {
+  }
+
+ public:
+  std::future<R> get_future() {
+    return promise_.get_future();
+  }
+
+  void operator()() {
+    try {
+      if constexpr (std::is_void_v<R>) {
+        f_();
+        promise_.set_value();
+      } else {
+        promise_.set_value(f_());
+      }
+    } catch (...) {
+      promise_.set_exception(std::current_exception());
+    }
+  }
+
+  // completes the future with `e` instead of running the task.
+  void fail(std::exception_ptr e) {
+    promise_.set_exception(std::move(e));
+  }
+
+ private:
+  std::promise<R> promise_;
+  F f_;
+};
+
+// the element type of the task queue: `QueueType::value_type` if it names one.
+template <typename QueueType, typename = void>
+struct queue_value {
+  using type = std::function<void()>;
+};
+
+template <typename QueueType>
+struct queue_value<QueueType, std::void_t<typename QueueType::value_type>> {
+  using type = typename QueueType::value_type;
+};
+
+// hands the pool's allocator to the task queue if the queue takes one.
+template <typename QueueType, typename Allocator,
+          bool = std::is_constructible_v<QueueType, const Allocator&>>
+class task_queue : public QueueType {
+ public:
+  explicit task_queue(const Allocator& alloc) : QueueType(alloc) {
+  }
+};
+
+template <typename QueueType, typename Allocator>
+class task_queue<QueueType, Allocator, false> : public QueueType {
+ public:
+  explicit task_queue(const Allocator&) {
+  }
+};
+
+// the pool the calling thread works for, if any, type-erased so that
+// `blocking_scope` need not know its type.
+struct worker_context {
+  void* pool{nullptr};
+  void (*begin_blocking)(void*){nullptr};
+  void (*end_blocking)(void*){nullptr};
+  int depth{0};
+  // among the workers and spares of `pool`, see `threadpool::max_threads`.
+  int index{-1};
+  // created on first use by `worker_scratch()`, reset after every task.
+  std::unique_ptr<scratch_arena> scratch;
+
+  void end_task() {
+    if (scratch) {
+      scratch->reset();
+    }
+  }
+};
+inline thread_local worker_context this_worker;
+}  // namespace detail
+
+// Tells the pool that the calling worker is about to block, e.g. on a future,
+// a lock or synchronous I/O, so that the pool lends a spare thread to run
+// queued tasks in its place until the scope closes. Scopes nest; only the
+// outermost one counts. A no-op on threads that are not pool workers.
+class blocking_scope {
+ public:
+  blocking_scope() {
+    auto& w = detail::this_worker;
+    if (w.pool != nullptr && w.depth++ == 0) {
+      w.begin_blocking(w.pool);
+    }
+  }
+  ~blocking_scope() {
+    auto& w = detail::this_worker;
+    if (w.pool != nullptr && --w.depth == 0) {
+      w.end_blocking(w.pool);
+    }
+  }
+  blocking_scope(const blocking_scope&) = delete;
+  blocking_scope& operator=(const blocking_scope&) = delete;
+};
+
+// `Allocator` provides the per-task storage (the task object and the shared
+// state of its future) and, if `QueueType` accepts it, the queue's nodes. The
+// `std::function` wrapping each task still uses the global heap.
+//
+// Besides its `num` workers the pool keeps up to `max_spares` spare threads,
+// started on demand and parked when idle. A spare only runs tasks while some
+// worker is inside a `blocking_scope`, one spare per blocked worker, so that
+// the number of runnable threads stays at `num`. On `terminate()` spares keep
+// standing in for blocked workers until the queue is drained, since those
+// may be waiting on a task still queued.
+template <typename QueueType = threadsafe_queue<std::function<void()>>,
+          typename Allocator = std::allocator<std::byte>>
 class threadpool {
  public:
   using wlock = std::unique_lock<std::shared_mutex>;
   using rlock = std::shared_lock<std::shared_mutex>;
+  using allocator_type = Allocator;
+  using queue_type = QueueType;
+  using task_type = typename detail::queue_value<QueueType>::type;
+
+ private:
+  // bits of `state_`; `kStop` and `kCancel` are mutually exclusive.
+  enum state_bits : unsigned {
+    kInited = 1U << 0,
+    kStop = 1U << 1,
+    kCancel = 1U << 2,
+  };
 
  public:
-  threadpool() = default;
+  threadpool() : threadpool(Allocator()) {
+  }
+  explicit threadpool(const Allocator& alloc) : tasks_(alloc), alloc_(alloc) {
+  }
   ~threadpool();
   threadpool(const threadpool&) = delete;
   threadpool(threadpool&&) = delete;
@@ -48,148 +189,403 @@ class threadpool {
   threadpool& operator=(threadpool&&) = delete;
 
  public:
-  void init(int num);
+  void init(int num, int max_spares = -1);  // `-1`: as many as `num`
+  // like `init`, but workers are started one by one, when a task arrives and
+  // none is idle, up to `num`.
+  void init_lazily(int num, int max_spares = -1);
   void terminate();  // stop and process all delegated tasks
   void cancel();     // stop and drop all tasks remained in queue
 
  public:
   bool inited() const;
   bool is_running() const;
-  int size() const;
-
- private:
-  bool _is_running() const {
-    return inited_ && !stop_ && !cancel_;
+  // whether `async()` would take a task, i.e. neither terminated nor canceled.
+  bool accepting() const;
+  // throws `std::runtime_error` unless `accepting()`; for wrappers that
+  // allocate a task before handing it to `post()`.
+  void check_accepting() const;
+  int size() const;         // workers started so far
+  int spares() const;       // spare threads started so far
+  int max_threads() const;  // workers and spares it may ever run
+  allocator_type get_allocator() const {
+    return alloc_;
   }
 
  private:
-  void spawn();
+  void start(int num, int max_spares, bool lazy);
+  bool shutdown(unsigned how);
+  void wakeup_one() const;
+  void start_worker() const;
+  void keep_up() const;
+  void spawn(int index);
+  void spare(int index);
+  void enter_worker(int index);
+  static void begin_blocking(void* pool);
+  static void end_blocking(void* pool);
 
  public:
   template <class F, class... Args>
   auto async(F&& f, Args&&... args) const -> std::future<decltype(f(args...))>;
 
+  // enqueues a `task_type` built from `args`, e.g. one that carries a
+  // deadline; `async()` is built on this.
+  template <class... Args>
+  void post(Args&&... args) const;
+
+  // runs `f(args...)` inside a `blocking_scope`.
+  template <class F, class... Args>
+  auto run_blocking(F&& f, Args&&... args) const -> decltype(f(args...)) {
+    blocking_scope scope;
+    return std::invoke(std::forward<F>(f), std::forward<Args>(args)...);
+  }
+
+  // registers a tenant with a task queue that supports them, such as
+  // `fair_queue`, and returns its handle.
+  template <class... Args>
+  auto make_tenant(Args&&... args) const {
+    return tasks_.make_tenant(*this, std::forward<Args>(args)...);
+  }
+
  private:
-  bool inited_{false};
-  bool stop_{false};
-  bool cancel_{false};
-  std::vector<std::thread> workers_;
-  mutable QueueType tasks_;
+  // `state_` is read by every `async()` and only written on lifecycle
+  // transitions, while `idle_` is bumped by workers whenever they park; keep
+  // them on separate cache lines so submitters don't bounce with consumers.
+  alignas(cacheline_size) std::atomic<unsigned> state_{0};
+  alignas(cacheline_size) mutable std::atomic<int> idle_{0};
+  mutable std::atomic<int> idle_spares_{0};
+  mutable std::atomic<int> unstarted_{0};  // workers `init_lazily` owes
+  // workers inside a `blocking_scope`, and spares running on their behalf.
+  alignas(cacheline_size) std::atomic<int> blocked_{0};
+  std::atomic<int> spares_active_{0};
+  // grows from `async()` when started lazily; guarded by `mtx_` until
+  // shutdown.
+  alignas(cacheline_size) mutable std::vector<std::thread> workers_;
+  std::vector<std::thread> spares_;  // guarded by `mtx_`, never reallocates
+  int max_workers_{0};               // guarded by `mtx_`
+  int max_spares_{0};                // guarded by `mtx_`
+  mutable detail::task_queue<QueueType, Allocator> tasks_;
+  const Allocator alloc_;
   mutable std::shared_mutex mtx_;
   mutable std::condition_variable_any cond_;
+  mutable std::condition_variable_any spare_cond_;
   mutable std::once_flag once_;
 };
 
-template <typename QueueType>
-inline threadpool<QueueType>::~threadpool() {
+template <typename QueueType, typename Allocator>
+inline threadpool<QueueType, Allocator>::~threadpool() {
   terminate();
 }
 
-template <typename QueueType>
-inline void threadpool<QueueType>::init(int num) {
-  std::call_once(once_, [this, num]() {
+template <typename QueueType, typename Allocator>
+inline void threadpool<QueueType, Allocator>::init(int num, int max_spares) {
+  start(num, max_spares, false);
+}
+
+template <typename QueueType, typename Allocator>
+inline void threadpool<QueueType, Allocator>::init_lazily(int num,
+                                                          int max_spares) {
+  start(num, max_spares, true);
+}
+
+template <typename QueueType, typename Allocator>
+inline void threadpool<QueueType, Allocator>::start(int num, int max_spares,
+                                                    bool lazy) {
+  std::call_once(once_, [this, num, max_spares, lazy]() {
     wlock lock(mtx_);
-    stop_ = false;
-    cancel_ = false;
+    max_workers_ = num;
+    max_spares_ = max_spares < 0 ? num : max_spares;
+    // reserved up front: `shutdown` walks the vector without the lock.
     workers_.reserve(num);
-    for (int i = 0; i < num; ++i) {
-      workers_.emplace_back(std::bind(&threadpool<QueueType>::spawn, this));
+    // spares may still start while `shutdown` joins them, see there.
+    spares_.reserve(max_spares_);
+    if (lazy) {
+      unstarted_.store(num, std::memory_order_relaxed);
+    } else {
+      for (int i = 0; i < num; ++i) {
+        workers_.emplace_back(std::bind(&threadpool::spawn, this, i));
+      }
     }
-    inited_ = true;
+    state_.store(kInited, std::memory_order_release);
   });
 }
 
-template <typename QueueType>
-inline void threadpool<QueueType>::terminate() {
+template <typename QueueType, typename Allocator>
+inline void threadpool<QueueType, Allocator>::terminate() {
+  shutdown(kStop);
+}
+
+template <typename QueueType, typename Allocator>
+inline void threadpool<QueueType, Allocator>::cancel() {
+  if (shutdown(kCancel)) {
+    tasks_.clear();
+  }
+}
+
+template <typename QueueType, typename Allocator>
+inline bool threadpool<QueueType, Allocator>::inited() const {
+  return state_.load(std::memory_order_acquire) & kInited;
+}
+
+template <typename QueueType, typename Allocator>
+inline bool threadpool<QueueType, Allocator>::is_running() const {
+  return state_.load(std::memory_order_acquire) == kInited;
+}
+
+template <typename QueueType, typename Allocator>
+inline int threadpool<QueueType, Allocator>::size() const {
+  rlock lock(mtx_);
+  return workers_.size();
+}
+
+template <typename QueueType, typename Allocator>
+inline int threadpool<QueueType, Allocator>::spares() const {
+  rlock lock(mtx_);
+  return spares_.size();
+}
+
+// Workers are numbered from 0 in the order they start, spares after all
+// workers; an index is never reused.
+template <typename QueueType, typename Allocator>
+inline int threadpool<QueueType, Allocator>::max_threads() const {
+  rlock lock(mtx_);
+  return max_workers_ + max_spares_;
+}
+
+// Moves a running pool into `kInited | how` and joins the workers. Only the
+// caller that wins the transition does so; returns whether that was us.
+template <typename QueueType, typename Allocator>
+inline bool threadpool<QueueType, Allocator>::shutdown(unsigned how) {
+  unsigned expected = kInited;
+  if (!state_.compare_exchange_strong(expected, kInited | how,
+                                      std::memory_order_acq_rel)) {
+    return false;
+  }
   {
+    // workers test `state_` while holding `mtx_`; taking it here ensures none
+    // of them is between that test and going to sleep, so none misses this.
     wlock lock(mtx_);
-    if (_is_running()) {
-      stop_ = true;
-    } else {
-      return;
-    }
   }
   cond_.notify_all();
+  spare_cond_.notify_all();
   for (auto& worker : workers_) {
     worker.join();
   }
+  // a spare that blocks may still start another while the queue drains, so
+  // look up each one under the lock; the vector never reallocates.
+  for (std::size_t i = 0;; ++i) {
+    std::thread* spare = nullptr;
+    {
+      rlock lock(mtx_);
+      if (i == spares_.size()) {
+        break;
+      }
+      spare = &spares_[i];
+    }
+    spare->join();
+  }
+  return true;
 }
 
-template <typename QueueType>
-inline void threadpool<QueueType>::cancel() {
-  {
-    wlock lock(mtx_);
-    if (_is_running()) {
-      cancel_ = true;
-    } else {
-      return;
+// Wakes a parked worker, if any. Workers register in `idle_` before they
+// check the queue, so either the worker sees the task just pushed or we see
+// the worker here; the lock closes the window between its check and its wait.
+// Spares park likewise in `idle_spares_` and are only worth waking while some
+// worker is blocked.
+template <typename QueueType, typename Allocator>
+inline void threadpool<QueueType, Allocator>::wakeup_one() const {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (idle_.load(std::memory_order_relaxed) > 0) {
+    {
+      rlock lock(mtx_);
     }
+    cond_.notify_one();
+  } else if (unstarted_.load(std::memory_order_relaxed) > 0) {
+    start_worker();
+  } else if (idle_spares_.load(std::memory_order_relaxed) > 0 &&
+             blocked_.load(std::memory_order_relaxed) > 0) {
+    {
+      rlock lock(mtx_);
+    }
+    spare_cond_.notify_one();
   }
-  tasks_.clear();
-  cond_.notify_all();
-  for (auto& worker : workers_) {
-    worker.join();
+}
+
+// every worker is busy: start one more, if `init_lazily` still owes some.
+template <typename QueueType, typename Allocator>
+inline void threadpool<QueueType, Allocator>::start_worker() const {
+  wlock lock(mtx_);
+  if (unstarted_.load(std::memory_order_relaxed) > 0 &&
+      state_.load(std::memory_order_acquire) == kInited) {
+    unstarted_.fetch_sub(1, std::memory_order_relaxed);
+    auto* self = const_cast<threadpool*>(this);
+    const int index = workers_.size();
+    workers_.emplace_back(std::bind(&threadpool::spawn, self, index));
   }
 }
 
-template <typename QueueType>
-inline bool threadpool<QueueType>::inited() const {
-  rlock lock(mtx_);
-  return inited_;
+template <typename QueueType, typename Allocator>
+inline void threadpool<QueueType, Allocator>::enter_worker(int index) {
+  auto& w = detail::this_worker;
+  w.pool = this;
+  w.index = index;
+  w.begin_blocking = &threadpool::begin_blocking;
+  w.end_blocking = &threadpool::end_blocking;
 }
 
-template <typename QueueType>
-inline bool threadpool<QueueType>::is_running() const {
-  rlock lock(mtx_);
-  return _is_running();
+// Makes sure there are as many spares as blocked workers, up to the cap, and
+// wakes one of them to take over.
+template <typename QueueType, typename Allocator>
+inline void threadpool<QueueType, Allocator>::begin_blocking(void* p) {
+  auto* self = static_cast<threadpool*>(p);
+  const int blocked =
+      self->blocked_.fetch_add(1, std::memory_order_seq_cst) + 1;
+  {
+    wlock lock(self->mtx_);
+    if (blocked > static_cast<int>(self->spares_.size()) &&
+        static_cast<int>(self->spares_.size()) < self->max_spares_ &&
+        !(self->state_.load(std::memory_order_acquire) & kCancel)) {
+      const int index = self->max_workers_ + self->spares_.size();
+      self->spares_.emplace_back(std::bind(&threadpool::spare, self, index));
+    }
+  }
+  self->spare_cond_.notify_one();
 }
 
-template <typename QueueType>
-inline int threadpool<QueueType>::size() const {
-  rlock lock(mtx_);
-  return workers_.size();
+// a spare still running on our behalf finishes its task, then parks.
+template <typename QueueType, typename Allocator>
+inline void threadpool<QueueType, Allocator>::end_blocking(void* p) {
+  static_cast<threadpool*>(p)->blocked_.fetch_sub(1, std::memory_order_relaxed);
 }
 
-template <typename QueueType>
-inline void threadpool<QueueType>::spawn() {
+template <typename QueueType, typename Allocator>
+inline void threadpool<QueueType, Allocator>::spawn(int index) {
+  enter_worker(index);
   for (;;) {
-    bool pop = false;
-    std::function<void()> task;
-    {
+    task_type task;
+    // a busy worker takes its next task without `mtx_`, so with a lock-free
+    // queue workers only contend on it when they run out of work.
+    bool pop = tasks_.pop(task);
+    unsigned state = state_.load(std::memory_order_acquire);
+    if (!pop) {
       wlock lock(mtx_);
-      cond_.wait(lock, [this, &pop, &task] {
+      idle_.fetch_add(1, std::memory_order_seq_cst);
+      cond_.wait(lock, [this, &pop, &task, &state] {
         pop = tasks_.pop(task);
-        return cancel_ || stop_ || pop;
+        state = state_.load(std::memory_order_acquire);
+        return (state & (kStop | kCancel)) || pop;
       });
+      idle_.fetch_sub(1, std::memory_order_seq_cst);
     }
-    if (cancel_ || (stop_ && !pop)) {
+    if ((state & kCancel) || ((state & kStop) && !pop)) {
+      // the queue is drained: let the spares go too.
+      spare_cond_.notify_all();
       return;
     }
+    if (pop && unstarted_.load(std::memory_order_relaxed) > 0) {
+      keep_up();
+    }
     task();
+    detail::this_worker.end_task();
   }
 }
 
-template <typename QueueType>
+// A burst of submitters may all have seen this worker idle before it woke
+// up, and only notified it. Now that it is busy, start one more worker if
+// work is still queued; the new one does the same. Submitters fence between
+// pushing and reading `idle_`, so either they see this worker busy or it
+// sees their task here.
+template <typename QueueType, typename Allocator>
+inline void threadpool<QueueType, Allocator>::keep_up() const {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!tasks_.empty()) {
+    start_worker();
+  }
+}
+
+// Like `spawn`, but only takes a task while holding one of the `blocked_`
+// permits. On `terminate()` it leaves once the queue is empty, as nothing can
+// be queued any more; until then a blocked worker may be waiting on a task
+// that only a spare can run.
+template <typename QueueType, typename Allocator>
+inline void threadpool<QueueType, Allocator>::spare(int index) {
+  enter_worker(index);
+  for (;;) {
+    bool pop = false;
+    unsigned state = 0;
+    task_type task;
+    {
+      wlock lock(mtx_);
+      idle_spares_.fetch_add(1, std::memory_order_seq_cst);
+      spare_cond_.wait(lock, [this, &pop, &task, &state] {
+        state = state_.load(std::memory_order_acquire);
+        if ((state & kCancel) || ((state & kStop) && tasks_.empty())) {
+          return true;
+        }
+        if (spares_active_.load(std::memory_order_relaxed) >=
+            blocked_.load(std::memory_order_relaxed)) {
+          return false;
+        }
+        pop = tasks_.pop(task);
+        return pop || (state & kStop);
+      });
+      idle_spares_.fetch_sub(1, std::memory_order_relaxed);
+      if (!pop) {
+        spare_cond_.notify_all();
+        return;
+      }
+      spares_active_.fetch_add(1, std::memory_order_relaxed);
+    }
+    task();
+    detail::this_worker.end_task();
+    spares_active_.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+template <typename QueueType, typename Allocator>
 template <class F, class... Args>
-auto threadpool<QueueType>::async(F&& f, Args&&... args) const
+auto threadpool<QueueType, Allocator>::async(F&& f, Args&&... args) const
     -> std::future<decltype(f(args...))> {
   using return_t = decltype(f(args...));
   using future_t = std::future<return_t>;
-  using task_t = std::packaged_task<return_t()>;
-
-  {
-    rlock lock(mtx_);
-    if (stop_ || cancel_)
-      throw std::runtime_error(
-          "Delegating task to a threadpool "
-          "that has been terminated or canceled.");
-  }
 
+  // refuse before allocating; `post()` checks again.
+  check_accepting();
   auto bind_func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
-  std::shared_ptr<task_t> task = std::make_shared<task_t>(std::move(bind_func));
+  using task_t = detail::pool_task<return_t, decltype(bind_func)>;
+  std::shared_ptr<task_t> task =
+      std::allocate_shared<task_t>(alloc_, alloc_, std::move(bind_func));
   future_t fut = task->get_future();
-  tasks_.emplace([task]() -> void { (*task)(); });
-  cond_.notify_one();
+  post([task]() -> void { (*task)(); });
   return fut;
 }
+
+template <typename QueueType, typename Allocator>
+template <class... Args>
+void threadpool<QueueType, Allocator>::post(Args&&... args) const {
+  check_accepting();
+  tasks_.emplace(std::forward<Args>(args)...);
+  wakeup_one();
+}
+
+template <typename QueueType, typename Allocator>
+inline bool threadpool<QueueType, Allocator>::accepting() const {
+  return !(state_.load(std::memory_order_acquire) & (kStop | kCancel));
+}
+
+template <typename QueueType, typename Allocator>
+inline void threadpool<QueueType, Allocator>::check_accepting() const {
+  if (!accepting())
+    throw std::runtime_error(
+        "Delegating task to a threadpool "
+        "that has been terminated or canceled.");
+}
+
+// tasks are allocated and released from many threads at once: back this with
+// a thread-safe resource such as `std::pmr::synchronized_pool_resource`.
+namespace pmr {
+template <typename QueueType =
+              yuuki::pmr::threadsafe_queue<std::function<void()>>>
+using threadpool =
+    yuuki::threadpool<QueueType, std::pmr::polymorphic_allocator<std::byte>>;
+}  // namespace pmr
 }  // namespace yuuki
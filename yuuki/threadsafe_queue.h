@@ -18,59 +18,101 @@
 #pragma once
 
 #include <memory>
+#include <memory_resource>
 #include <mutex>
 #include <shared_mutex>
 #include <utility>
 
 namespace yuuki {
-template <typename T>
+template <typename T, typename Allocator = std::allocator<T>>
 class threadsafe_queue {
  public:
   using wlock = std::unique_lock<std::shared_mutex>;
   using rlock = std::shared_lock<std::shared_mutex>;
+  using value_type = T;
+  using allocator_type = Allocator;
 
  private:
   struct node {
     T data;
-    std::unique_ptr<node> next;
+    node* next{nullptr};
     node() = default;
     explicit node(T data_) : data(std::move(data_)) {
     }
   };
+  using node_allocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<node>;
+  using node_traits = std::allocator_traits<node_allocator>;
 
+  // nodes are allocated by producers and released by consumers concurrently,
+  // so the allocator has to be thread-safe.
+  node_allocator alloc_;
   mutable std::shared_mutex head_mutex_;
-  std::unique_ptr<node> head_{nullptr};
+  node* head_{nullptr};
   mutable std::shared_mutex tail_mutex_;
   node* tail_{nullptr};
 
  public:
-  threadsafe_queue() : head_(std::make_unique<node>()), tail_(head_.get()) {
+  threadsafe_queue() : threadsafe_queue(Allocator()) {
+  }
+  explicit threadsafe_queue(const Allocator& alloc)
+      : alloc_(alloc), head_(make_node()), tail_(head_) {
   }
   ~threadsafe_queue() {
     clear();
+    drop_node(head_);
   }
   threadsafe_queue(const threadsafe_queue& other) = delete;
   threadsafe_queue& operator=(const threadsafe_queue& other) = delete;
 
  private:
+  node* make_node() {
+    node* p = node_traits::allocate(alloc_, 1);
+    try {
+      node_traits::construct(alloc_, p);
+    } catch (...) {
+      node_traits::deallocate(alloc_, p, 1);
+      throw;
+    }
+    return p;
+  }
+
+  void drop_node(node* p) {
+    node_traits::destroy(alloc_, p);
+    node_traits::deallocate(alloc_, p, 1);
+  }
+
+  // owns a node until it is linked in.
+  struct node_deleter {
+    threadsafe_queue* queue;
+    void operator()(node* p) const {
+      queue->drop_node(p);
+    }
+  };
+  using node_ptr = std::unique_ptr<node, node_deleter>;
+
   node* tail() const {
     rlock lock(tail_mutex_);
     return tail_;
   }
 
  public:
+  allocator_type get_allocator() const {
+    return allocator_type(alloc_);
+  }
+
   bool empty() const {
     rlock lock(head_mutex_);
-    return tail() == head_.get();
+    return tail() == head_;
   }
 
   size_t size() const {
     rlock h_lock(head_mutex_);
     rlock t_lock(tail_mutex_);
-    node* work = head_.get();
+    node* work = head_;
     size_t res = 0;
     while (work != tail_) {
-      work = work->next.get();
+      work = work->next;
       ++res;
     }
     return res;
@@ -80,38 +122,49 @@ class threadsafe_queue {
   void clear() {
     wlock h_lock(head_mutex_);
     wlock t_lock(tail_mutex_);
-    std::make_unique<node>().swap(head_);
-    tail_ = head_.get();
+    while (head_ != tail_) {
+      node* old_head = head_;
+      head_ = old_head->next;
+      drop_node(old_head);
+    }
   }
 
   bool pop(T& holder) {
-    wlock lock(head_mutex_);
-    if (head_.get() == tail()) {
-      return false;
+    node* old_head;
+    {
+      wlock lock(head_mutex_);
+      if (head_ == tail()) {
+        return false;
+      }
+      holder = std::move(head_->data);
+      old_head = head_;
+      head_ = old_head->next;
     }
-    holder = std::move(head_->data);
-    const std::unique_ptr<node> old_head = std::move(head_);
-    head_ = std::move(old_head->next);
+    drop_node(old_head);
     return true;
   }
 
   void push(T new_value) {
-    std::unique_ptr<node> p = std::make_unique<node>();
-    node* const new_tail = p.get();
+    node_ptr new_tail(make_node(), node_deleter{this});
     wlock lock(tail_mutex_);
     tail_->data = std::move(new_value);
-    tail_->next = std::move(p);
-    tail_ = new_tail;
+    tail_->next = new_tail.release();
+    tail_ = tail_->next;
   }
 
   template <typename... Args>
   void emplace(Args... args) {
-    std::unique_ptr<node> p = std::make_unique<node>();
-    node* const new_tail = p.get();
+    node_ptr new_tail(make_node(), node_deleter{this});
     wlock lock(tail_mutex_);
     tail_->data = T(std::forward<Args>(args)...);
-    tail_->next = std::move(p);
-    tail_ = new_tail;
+    tail_->next = new_tail.release();
+    tail_ = tail_->next;
   }
 };
+
+namespace pmr {
+template <typename T>
+using threadsafe_queue =
+    yuuki::threadsafe_queue<T, std::pmr::polymorphic_allocator<T>>;
+}  // namespace pmr
 }  // namespace yuuki
@@ -0,0 +1,166 @@
+// =========================================================================
+// Copyright 2022 -- present Liam Huang (Yuuki) [liamhuang0205@gmail.com].
+// Author: Liam Huang
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// =========================================================================
+
+#pragma once
+
+#include <yuuki/cacheline.h>
+#include <yuuki/scratch_arena.h>
+#include <yuuki/threadpool.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace yuuki {
+// Scratch memory for the task running on the calling worker: a
+// `scratch_arena` of that worker, handed back when the task returns, so
+// temporary buffers cost no heap allocation once the arena has grown to the
+// tasks' needs. Everything built on it must be gone by then. Outside pools
+// this is the default resource.
+inline std::pmr::memory_resource* worker_scratch() {
+  auto& w = detail::this_worker;
+  if (w.pool == nullptr) {
+    return std::pmr::get_default_resource();
+  }
+  if (!w.scratch) {
+    w.scratch = std::make_unique<scratch_arena>();
+  }
+  return w.scratch.get();
+}
+
+// Hands back the worker's scratch memory allocated within the scope, e.g. per
+// item of a batch processed by one task. Scopes nest. A no-op outside pools.
+class scratch_scope {
+ public:
+  scratch_scope()
+      : arena_(detail::this_worker.pool != nullptr
+                   ? static_cast<scratch_arena*>(worker_scratch())
+                   : nullptr),
+        mark_(arena_ != nullptr ? arena_->mark() : scratch_arena::marker{}) {
+  }
+  ~scratch_scope() {
+    if (arena_ != nullptr) {
+      arena_->rewind(mark_);
+    }
+  }
+  scratch_scope(const scratch_scope&) = delete;
+  scratch_scope& operator=(const scratch_scope&) = delete;
+
+ private:
+  scratch_arena* arena_;
+  scratch_arena::marker mark_;
+};
+
+// One `T` per worker of a pool, constructed by `init()` when the worker first
+// asks for it, e.g. the partial result of a parallel phase or a buffer reused
+// by every task of the worker. Unlike a `thread_local`, the instances belong
+// to this object: they are destroyed with it and may be visited, combined or
+// cleared once the phase is over. Workers reach theirs without locking;
+// threads outside the pool, and all threads if this is constructed before the
+// pool is initialized, get one each through a lock. `local()` may be called
+// concurrently; the other members may not run concurrently with it.
+template <typename T>
+class worker_local {
+ private:
+  struct alignas(cacheline_size) slot {
+    std::atomic<T*> value{nullptr};
+  };
+
+ public:
+  template <typename Pool>
+  explicit worker_local(const Pool& pool,
+                        std::function<T()> init = []() { return T(); })
+      : pool_(&pool),
+        init_(std::move(init)),
+        num_slots_(pool.max_threads()),
+        slots_(std::make_unique<slot[]>(num_slots_)) {
+  }
+  ~worker_local() {
+    clear();
+  }
+  worker_local(const worker_local&) = delete;
+  worker_local& operator=(const worker_local&) = delete;
+
+ public:
+  // the calling thread's instance.
+  T& local() {
+    auto& w = detail::this_worker;
+    if (w.pool == pool_ && w.index >= 0 &&
+        static_cast<size_t>(w.index) < num_slots_) {
+      // the slot is only ever written by its own worker.
+      slot& s = slots_[w.index];
+      T* value = s.value.load(std::memory_order_relaxed);
+      if (value == nullptr) {
+        value = new T(init_());
+        s.value.store(value, std::memory_order_release);
+      }
+      return *value;
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto& value = others_[std::this_thread::get_id()];
+    if (!value) {
+      value = std::make_unique<T>(init_());
+    }
+    return *value;
+  }
+
+  // calls `f(T&)` on every instance constructed so far.
+  template <typename F>
+  void for_each(F&& f) {
+    for (size_t i = 0; i != num_slots_; ++i) {
+      if (T* value = slots_[i].value.load(std::memory_order_acquire)) {
+        f(*value);
+      }
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (auto& kv : others_) {
+      f(*kv.second);
+    }
+  }
+
+  // folds every instance constructed so far into `init` with `op`.
+  template <typename BinaryOperation = std::plus<>>
+  T combine(T init = T(), BinaryOperation op = BinaryOperation()) {
+    for_each([&init, &op](T& value) { init = op(std::move(init), value); });
+    return init;
+  }
+
+  // destroys every instance; the next `local()` constructs a fresh one.
+  void clear() {
+    for (size_t i = 0; i != num_slots_; ++i) {
+      delete slots_[i].value.exchange(nullptr, std::memory_order_acq_rel);
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    others_.clear();
+  }
+
+ private:
+  const void* pool_;
+  const std::function<T()> init_;
+  const size_t num_slots_;
+  std::unique_ptr<slot[]> slots_;
+  std::mutex mtx_;
+  // threads outside the pool; guarded by `mtx_`.
+  std::unordered_map<std::thread::id, std::unique_ptr<T>> others_;
+};
+}  // namespace yuuki